@@ -180,11 +180,12 @@ struct Color3f {
         return ret;
     }
 
+    // Zero for channels that are not positive, as `simd::pow`
     friend Color3f pow(const Color3f &c, float exponent) {
         Color3f ret;
-        ret[0] = std::pow(c[0], exponent);
-        ret[1] = std::pow(c[1], exponent);
-        ret[2] = std::pow(c[2], exponent);
+        ret[0] = c[0] > 0.f ? std::pow(c[0], exponent) : 0.f;
+        ret[1] = c[1] > 0.f ? std::pow(c[1], exponent) : 0.f;
+        ret[2] = c[2] > 0.f ? std::pow(c[2], exponent) : 0.f;
         return ret;
     }
 
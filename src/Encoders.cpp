@@ -0,0 +1,841 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <Encoders.h>
+#include <Parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+// Only for the constants of the EXR header, the implementation is part of Image.cpp
+#include <tinyexr.h>
+
+namespace tonemapper {
+
+namespace {
+
+/* Write the byte sequences in `parts` one after another into `filename`, or to
+   standard output for "-" */
+bool writeFile(const std::string &filename, const std::vector<std::vector<uint8_t>> &parts) {
+    if (filename == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        for (const std::vector<uint8_t> &part : parts) {
+            if (fwrite(part.data(), 1, part.size(), stdout) != part.size()) {
+                return false;
+            }
+        }
+        return fflush(stdout) == 0;
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    for (const std::vector<uint8_t> &part : parts) {
+        file.write((const char *) part.data(), std::streamsize(part.size()));
+    }
+    return bool(file);
+}
+
+inline void putBigEndian16(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(uint8_t(value >> 8));
+    out.push_back(uint8_t(value));
+}
+
+inline void putBigEndian32(std::vector<uint8_t> &out, uint32_t value) {
+    putBigEndian16(out, value >> 16);
+    putBigEndian16(out, value & 0xffff);
+}
+
+inline void putLittleEndian16(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(uint8_t(value));
+    out.push_back(uint8_t(value >> 8));
+}
+
+inline void putLittleEndian32(std::vector<uint8_t> &out, uint32_t value) {
+    putLittleEndian16(out, value & 0xffff);
+    putLittleEndian16(out, value >> 16);
+}
+
+// Append a PNG chunk of type `type`, with its length and CRC
+void putPNGChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t size) {
+    putBigEndian32(out, uint32_t(size));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    putBigEndian32(out, zlibCRC32(0, out.data() + start, size + 4));
+}
+
+/* Apply one of the PNG row filters to the `size` bytes of `row`, with `bpp`
+   bytes per pixel. `prior` is the previous row, or nullptr for the first one.
+   Level 0 stores the rows unfiltered, level 1 uses the "Sub" filter that turns
+   flat areas into runs of zeros, and higher levels pick the filter with the
+   smallest sum of absolute (signed) values, like libpng does. */
+void filterPNGRow(const uint8_t *row, const uint8_t *prior, size_t size, size_t bpp, int level,
+                  std::vector<uint8_t> &scratch, uint8_t *out) {
+    scratch.assign(size, 0);
+    const uint8_t *up = prior ? prior : scratch.data();
+
+    // The first `bpp` bytes have no left neighbor, which the filters treat as zero
+    auto filter = [&](uint8_t *dst, auto predict) {
+        for (size_t i = 0; i < std::min(bpp, size); ++i) {
+            dst[i] = uint8_t(row[i] - predict(0, up[i], 0));
+        }
+        for (size_t i = bpp; i < size; ++i) {
+            dst[i] = uint8_t(row[i] - predict(row[i - bpp], up[i], up[i - bpp]));
+        }
+    };
+    auto apply = [&](int type, uint8_t *dst) {
+        dst[0] = uint8_t(type);
+        dst++;
+        switch (type) {
+            case 0: std::copy(row, row + size, dst); break;
+            case 1: filter(dst, [](int a, int, int) { return a; }); break;
+            case 2: filter(dst, [](int, int b, int) { return b; }); break;
+            case 3: filter(dst, [](int a, int b, int) { return (a + b) / 2; }); break;
+            default:
+                filter(dst, [](int a, int b, int c) {
+                    int p = a + b - c,
+                        pa = std::abs(p - a),
+                        pb = std::abs(p - b),
+                        pc = std::abs(p - c);
+                    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                });
+        }
+    };
+
+    if (level <= 1) {
+        apply(level == 0 ? 0 : 1, out);
+        return;
+    }
+
+    std::vector<uint8_t> candidate(size + 1);
+    size_t bestCost = std::numeric_limits<size_t>::max();
+    for (int type = 0; type < 5; ++type) {
+        apply(type, candidate.data());
+        size_t cost = 0;
+        for (size_t i = 1; i <= size; ++i) {
+            cost += size_t(std::abs(int(int8_t(candidate[i]))));
+        }
+        if (cost < bestCost) {
+            bestCost = cost;
+            std::copy(candidate.begin(), candidate.end(), out);
+        }
+    }
+}
+
+// Adler-32 checksum of two concatenated sequences, the second one of `length2` bytes
+uint32_t combineAdler32(uint32_t adler1, uint32_t adler2, size_t length2) {
+    const uint32_t base = 65521;
+    uint32_t remainder = uint32_t(length2 % base),
+             sum1 = adler1 & 0xffff,
+             sum2 = uint32_t((uint64_t(remainder) * sum1) % base);
+    sum1 += (adler2 & 0xffff) + base - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + base - remainder;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= 2 * base) sum2 -= 2 * base;
+    if (sum2 >= base) sum2 -= base;
+    return sum1 | (sum2 << 16);
+}
+
+/* Input bytes per band of rows of the parallel encoders. PNG bands are
+   deflated on their own, TIFF bands become strips. */
+constexpr size_t BandSize = 256 * 1024;
+
+// Position of the coefficients of an 8x8 block in zig-zag order
+const uint8_t JPEGZigZag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Quantization tables from Annex K of the JPEG standard, for luma and chroma
+const uint8_t JPEGQuantization[2][64] = {
+    { 16, 11, 10, 16,  24,  40,  51,  61,  12, 12, 14, 19,  26,  58,  60,  55,
+      14, 13, 16, 24,  40,  57,  69,  56,  14, 17, 22, 29,  51,  87,  80,  62,
+      18, 22, 37, 56,  68, 109, 103,  77,  24, 35, 55, 64,  81, 104, 113,  92,
+      49, 64, 78, 87, 103, 121, 120, 101,  72, 92, 95, 98, 112, 100, 103,  99 },
+    { 17, 18, 24, 47, 99, 99, 99, 99,  18, 21, 26, 66, 99, 99, 99, 99,
+      24, 26, 56, 99, 99, 99, 99, 99,  47, 66, 99, 99, 99, 99, 99, 99,
+      99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99,
+      99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99 }
+};
+
+/* Huffman tables from Annex K of the JPEG standard: the number of codes of
+   each length (1 to 16 bits) followed by the symbols. */
+const uint8_t JPEGDCLumaBits[16]   = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t JPEGDCChromaBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t JPEGDCSymbols[12]    = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+const uint8_t JPEGACLumaBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t JPEGACLumaSymbols[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+const uint8_t JPEGACChromaBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t JPEGACChromaSymbols[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// Code and length of each symbol of a Huffman table
+struct JPEGHuffmanCodes {
+    JPEGHuffmanCodes(const uint8_t bits[16], const uint8_t *symbols) {
+        uint16_t next = 0;
+        for (int length = 1, k = 0; length <= 16; ++length, next <<= 1) {
+            for (int i = 0; i < bits[length - 1]; ++i, ++k) {
+                code[symbols[k]] = next++;
+                size[symbols[k]] = uint8_t(length);
+            }
+        }
+    }
+
+    uint16_t code[256] = {};
+    uint8_t size[256] = {};
+};
+
+// Writer for entropy coded data, which escapes 0xff bytes
+struct JPEGBitWriter {
+    JPEGBitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+    inline void put(uint32_t bits, int length) {
+        buffer = (buffer << length) | bits;
+        count += length;
+        while (count >= 8) {
+            uint8_t byte = uint8_t(buffer >> (count - 8));
+            out.push_back(byte);
+            if (byte == 0xff) out.push_back(0);
+            count -= 8;
+        }
+        buffer &= (1u << count) - 1;
+    }
+
+    inline void put(const JPEGHuffmanCodes &codes, int symbol) {
+        put(codes.code[symbol], codes.size[symbol]);
+    }
+
+    // Pad the last byte with 1-bits
+    inline void flush() {
+        if (count > 0) put((1u << (8 - count)) - 1, 8 - count);
+    }
+
+    std::vector<uint8_t> &out;
+    uint32_t buffer = 0;
+    int count = 0;
+};
+
+/* In-place forward DCT of 8 values that are `stride` apart, with the
+   factorization of Arai, Agui and Nakajima. The outputs are scaled by the AAN
+   factors, which are folded into the quantization. */
+inline void forwardDCT(float *d, size_t stride) {
+    float *d0 = d,              *d1 = d + stride,     *d2 = d + 2 * stride, *d3 = d + 3 * stride,
+          *d4 = d + 4 * stride, *d5 = d + 5 * stride, *d6 = d + 6 * stride, *d7 = d + 7 * stride;
+
+    float tmp0 = *d0 + *d7, tmp7 = *d0 - *d7,
+          tmp1 = *d1 + *d6, tmp6 = *d1 - *d6,
+          tmp2 = *d2 + *d5, tmp5 = *d2 - *d5,
+          tmp3 = *d3 + *d4, tmp4 = *d3 - *d4;
+
+    // Even part
+    float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3,
+          tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+    *d0 = tmp10 + tmp11;
+    *d4 = tmp10 - tmp11;
+    float z1 = (tmp12 + tmp13) * 0.707106781f;
+    *d2 = tmp13 + z1;
+    *d6 = tmp13 - z1;
+
+    // Odd part
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+    float z5 = (tmp10 - tmp12) * 0.382683433f,
+          z2 = tmp10 * 0.541196100f + z5,
+          z4 = tmp12 * 1.306562965f + z5,
+          z3 = tmp11 * 0.707106781f,
+          z11 = tmp7 + z3,
+          z13 = tmp7 - z3;
+    *d5 = z13 + z2;
+    *d3 = z13 - z2;
+    *d1 = z11 + z4;
+    *d7 = z11 - z4;
+}
+
+inline int bitLength(int value) {
+    int length = 0;
+    for (unsigned int v = unsigned(std::abs(value)); v; v >>= 1) length++;
+    return length;
+}
+
+} // Anonymous namespace
+
+/* Parallel PNG encoder for RGB data with 8 or 16 (`uint16_t`) bits per
+   channel. Bands of rows are filtered and deflated independently, ending with
+   a full flush so that they can be concatenated into one zlib stream. The
+   checksums of the bands are combined at the end. The output only depends on
+   the image and the level, not on the number of threads. */
+bool encodePNG(const std::string &filename, const void *pixels, size_t width, size_t height,
+               int bitDepth, int level) {
+    level = std::clamp(level, 0, 9);
+
+    size_t bpp = 3 * size_t(bitDepth / 8),
+           rowSize = bpp * width,
+           bandRows = std::max(size_t(1), BandSize / std::max(size_t(1), rowSize)),
+           bands = (height + bandRows - 1) / bandRows;
+
+    std::vector<std::vector<uint8_t>> parts(bands + 2);
+    std::vector<uint32_t> adler(bands);
+    std::vector<size_t> filteredSize(bands);
+    std::atomic<bool> success(true);
+
+    ThreadPool::get().parallelFor(bands, [&](size_t band) {
+        size_t i0 = band * bandRows,
+               i1 = std::min(i0 + bandRows, height);
+
+        // Rows of the band and the one before it, 16-bit samples are stored in big-endian byte order
+        size_t first = i0 > 0 ? i0 - 1 : 0;
+        const uint8_t *rows = (const uint8_t *) pixels + first * rowSize;
+        std::vector<uint8_t> swapped;
+        if (bitDepth == 16) {
+            swapped.resize((i1 - first) * rowSize);
+            const uint16_t *values = (const uint16_t *) pixels + first * 3 * width;
+            for (size_t k = 0; k < swapped.size() / 2; ++k) {
+                swapped[2 * k]     = uint8_t(values[k] >> 8);
+                swapped[2 * k + 1] = uint8_t(values[k]);
+            }
+            rows = swapped.data();
+        }
+
+        std::vector<uint8_t> filtered((i1 - i0) * (rowSize + 1)), scratch;
+        for (size_t i = i0; i < i1; ++i) {
+            const uint8_t *row = rows + (i - first) * rowSize;
+            filterPNGRow(row, i > 0 ? row - rowSize : nullptr, rowSize, bpp, level,
+                         scratch, filtered.data() + (i - i0) * (rowSize + 1));
+        }
+        adler[band] = zlibAdler32(1, filtered.data(), filtered.size());
+        filteredSize[band] = filtered.size();
+
+        std::vector<uint8_t> compressed;
+        if (band == 0) {
+            // zlib header, with the compression level as a hint
+            compressed.push_back(0x78);
+            compressed.push_back(level <= 1 ? 0x01 : level <= 5 ? 0x5e : level == 6 ? 0x9c : 0xda);
+        }
+        if (!zlibDeflate(filtered.data(), filtered.size(), level, band + 1 == bands, compressed)) {
+            success = false;
+        }
+
+        putPNGChunk(parts[band + 1], "IDAT", compressed.data(), compressed.size());
+    });
+    if (!success) {
+        return false;
+    }
+
+    std::vector<uint8_t> &header = parts.front();
+    const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    header.insert(header.end(), signature, signature + 8);
+    std::vector<uint8_t> info;
+    putBigEndian32(info, uint32_t(width));
+    putBigEndian32(info, uint32_t(height));
+    const uint8_t format[] = { uint8_t(bitDepth), 2, 0, 0, 0 };     // RGB, no interlacing
+    info.insert(info.end(), format, format + 5);
+    putPNGChunk(header, "IHDR", info.data(), info.size());
+
+    uint32_t checksum = bands > 0 ? adler[0] : 1;
+    for (size_t band = 1; band < bands; ++band) {
+        checksum = combineAdler32(checksum, adler[band], filteredSize[band]);
+    }
+    std::vector<uint8_t> trailer;
+    putBigEndian32(trailer, checksum);
+    putPNGChunk(parts.back(), "IDAT", trailer.data(), trailer.size());
+    putPNGChunk(parts.back(), "IEND", nullptr, 0);
+
+    return writeFile(filename, parts);
+}
+
+/* Parallel baseline JPEG encoder. Each row of MCUs is a restart interval, so
+   the rows are entropy coded independently and joined with restart markers. */
+bool encodeJPEG(const std::string &filename, const uint8_t *rgb8, size_t width, size_t height,
+                int quality, ChromaSubsampling subsampling) {
+    if (width == 0 || height == 0 || width > 65535 || height > 65535) {
+        return false;
+    }
+
+    // Quantization tables in zig-zag order, and the scale factors applied to the DCT output
+    const float aan[8] = { 1.f, 1.387039845f, 1.306562965f, 1.175875602f,
+                           1.f, 0.785694958f, 0.541196100f, 0.275899379f };
+    quality = std::clamp(quality, 1, 100);
+    int qualityScale = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+    uint8_t tables[2][64];
+    float scales[2][64];
+    for (size_t t = 0; t < 2; ++t) {
+        for (size_t k = 0; k < 64; ++k) {
+            size_t n = JPEGZigZag[k];
+            tables[t][k] = uint8_t(std::clamp((JPEGQuantization[t][n] * qualityScale + 50) / 100, 1, 255));
+            scales[t][n] = 1.f / (float(tables[t][k]) * aan[n / 8] * aan[n % 8] * 8.f);
+        }
+    }
+
+    static const JPEGHuffmanCodes dcCodes[2] = { { JPEGDCLumaBits, JPEGDCSymbols }, { JPEGDCChromaBits, JPEGDCSymbols } },
+                                  acCodes[2] = { { JPEGACLumaBits, JPEGACLumaSymbols }, { JPEGACChromaBits, JPEGACChromaSymbols } };
+
+    size_t hs = subsampling == ChromaSubsampling::Chroma444 ? 1 : 2,
+           vs = subsampling == ChromaSubsampling::Chroma420 ? 2 : 1,
+           mcuWidth  = 8 * hs,
+           mcuHeight = 8 * vs,
+           mcusX = (width  + mcuWidth  - 1) / mcuWidth,
+           mcusY = (height + mcuHeight - 1) / mcuHeight;
+
+    auto encodeBlock = [&](JPEGBitWriter &writer, float block[64], size_t t, int &dc) {
+        for (size_t i = 0; i < 8; ++i) forwardDCT(block + 8 * i, 1);
+        for (size_t j = 0; j < 8; ++j) forwardDCT(block + j, 8);
+
+        int q[64];
+        for (size_t k = 0; k < 64; ++k) {
+            size_t n = JPEGZigZag[k];
+            q[k] = int(std::lrint(block[n] * scales[t][n]));
+        }
+
+        // Values are coded as their bit length, followed by the bits (one's complement if negative)
+        auto putValue = [&](int value, int length) {
+            if (length > 0) writer.put(uint32_t(value < 0 ? value - 1 : value) & ((1u << length) - 1), length);
+        };
+
+        int diff = q[0] - dc;
+        dc = q[0];
+        int length = bitLength(diff);
+        writer.put(dcCodes[t], length);
+        putValue(diff, length);
+
+        int run = 0;
+        for (size_t k = 1; k < 64; ++k) {
+            if (q[k] == 0) {
+                run++;
+                continue;
+            }
+            for (; run > 15; run -= 16) writer.put(acCodes[t], 0xf0);
+            length = bitLength(q[k]);
+            writer.put(acCodes[t], (run << 4) | length);
+            putValue(q[k], length);
+            run = 0;
+        }
+        if (run > 0) writer.put(acCodes[t], 0x00);
+    };
+
+    std::vector<std::vector<uint8_t>> parts(mcusY + 2);
+    ThreadPool::get().parallelFor(mcusY, [&](size_t my) {
+        std::vector<uint8_t> &out = parts[my + 1];
+        JPEGBitWriter writer(out);
+        int dc[3] = { 0, 0, 0 };
+
+        float planes[3][16 * 16], block[64];
+        for (size_t mx = 0; mx < mcusX; ++mx) {
+            // Convert to level shifted YCbCr, pixels past the edge repeat the last row and column
+            for (size_t y = 0; y < mcuHeight; ++y) {
+                const uint8_t *row = rgb8 + 3 * width * std::min(my * mcuHeight + y, height - 1);
+                for (size_t x = 0; x < mcuWidth; ++x) {
+                    const uint8_t *p = row + 3 * std::min(mx * mcuWidth + x, width - 1);
+                    float r = p[0], g = p[1], b = p[2];
+                    size_t i = y * mcuWidth + x;
+                    planes[0][i] =  0.299f    * r + 0.587f    * g + 0.114f    * b - 128.f;
+                    planes[1][i] = -0.168736f * r - 0.331264f * g + 0.5f      * b;
+                    planes[2][i] =  0.5f      * r - 0.418688f * g - 0.081312f * b;
+                }
+            }
+
+            for (size_t by = 0; by < vs; ++by) {
+                for (size_t bx = 0; bx < hs; ++bx) {
+                    for (size_t k = 0; k < 64; ++k) {
+                        block[k] = planes[0][(8 * by + k / 8) * mcuWidth + 8 * bx + k % 8];
+                    }
+                    encodeBlock(writer, block, 0, dc[0]);
+                }
+            }
+
+            // Chroma blocks average the subsampled pixels
+            float weight = 1.f / float(hs * vs);
+            for (size_t ch = 1; ch < 3; ++ch) {
+                for (size_t k = 0; k < 64; ++k) {
+                    float sum = 0.f;
+                    for (size_t y = 0; y < vs; ++y) {
+                        for (size_t x = 0; x < hs; ++x) {
+                            sum += planes[ch][(vs * (k / 8) + y) * mcuWidth + hs * (k % 8) + x];
+                        }
+                    }
+                    block[k] = sum * weight;
+                }
+                encodeBlock(writer, block, 1, dc[ch]);
+            }
+        }
+
+        writer.flush();
+        if (my + 1 < mcusY) {
+            out.push_back(0xff);
+            out.push_back(uint8_t(0xd0 + my % 8));
+        }
+    });
+
+    std::vector<uint8_t> &header = parts.front();
+    const uint8_t app0[] = { 0xff, 0xd8, 0xff, 0xe0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    header.insert(header.end(), app0, app0 + sizeof(app0));
+
+    putBigEndian16(header, 0xffdb);
+    putBigEndian16(header, 2 + 2 * 65);
+    for (size_t t = 0; t < 2; ++t) {
+        header.push_back(uint8_t(t));
+        header.insert(header.end(), tables[t], tables[t] + 64);
+    }
+
+    putBigEndian16(header, 0xffc0);
+    putBigEndian16(header, 17);
+    header.push_back(8);
+    putBigEndian16(header, uint32_t(height));
+    putBigEndian16(header, uint32_t(width));
+    const uint8_t components[] = { 3, 1, uint8_t((hs << 4) | vs), 0, 2, 0x11, 1, 3, 0x11, 1 };
+    header.insert(header.end(), components, components + sizeof(components));
+
+    const uint8_t *huffmanBits[4]    = { JPEGDCLumaBits, JPEGACLumaBits, JPEGDCChromaBits, JPEGACChromaBits },
+                  *huffmanSymbols[4] = { JPEGDCSymbols, JPEGACLumaSymbols, JPEGDCSymbols, JPEGACChromaSymbols };
+    const uint8_t huffmanClasses[4] = { 0x00, 0x10, 0x01, 0x11 };
+    std::vector<uint8_t> huffman;
+    for (size_t t = 0; t < 4; ++t) {
+        size_t count = 0;
+        for (size_t i = 0; i < 16; ++i) count += huffmanBits[t][i];
+        huffman.push_back(huffmanClasses[t]);
+        huffman.insert(huffman.end(), huffmanBits[t], huffmanBits[t] + 16);
+        huffman.insert(huffman.end(), huffmanSymbols[t], huffmanSymbols[t] + count);
+    }
+    putBigEndian16(header, 0xffc4);
+    putBigEndian16(header, uint32_t(2 + huffman.size()));
+    header.insert(header.end(), huffman.begin(), huffman.end());
+
+    // One restart interval per row of MCUs
+    putBigEndian16(header, 0xffdd);
+    putBigEndian16(header, 4);
+    putBigEndian16(header, uint32_t(mcusX));
+
+    const uint8_t scan[] = { 0xff, 0xda, 0, 12, 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+    header.insert(header.end(), scan, scan + sizeof(scan));
+
+    putBigEndian16(parts.back(), 0xffd9);
+    return writeFile(filename, parts);
+}
+
+/* Uncompressed ".tif" file with 16-bit RGB data, in little-endian byte order.
+   Each band of rows is one strip, and the strips are converted in parallel. */
+bool encodeTIFF(const std::string &filename, const uint16_t *rgb16, size_t width, size_t height) {
+    size_t rowSize = 6 * width,
+           stripRows = std::max(size_t(1), BandSize / std::max(size_t(1), rowSize)),
+           strips = (height + stripRows - 1) / stripRows;
+
+    // Header, directory, the values that do not fit into it, and then the strips
+    const uint32_t entries = 13;
+    size_t directoryOffset  = 8,
+           bitsOffset       = directoryOffset + 2 + 12 * entries + 4,
+           resolutionOffset = bitsOffset + 6,
+           offsetsOffset    = resolutionOffset + 16,
+           countsOffset     = offsetsOffset + 4 * strips,
+           dataOffset       = countsOffset + 4 * strips;
+    if (dataOffset + rowSize * height > std::numeric_limits<uint32_t>::max()) {
+        return false;   // Offsets of classic TIFF files are limited to 32 bits
+    }
+
+    std::vector<std::vector<uint8_t>> parts(strips + 1);
+    std::vector<uint8_t> &header = parts.front();
+    header.push_back('I');
+    header.push_back('I');
+    putLittleEndian16(header, 42);
+    putLittleEndian32(header, uint32_t(directoryOffset));
+
+    // Entries with a single value (or array) that fits into four bytes store it directly
+    putLittleEndian16(header, entries);
+    auto entry = [&](uint32_t tag, uint32_t type, uint32_t count, uint32_t value) {
+        putLittleEndian16(header, tag);
+        putLittleEndian16(header, type);
+        putLittleEndian32(header, count);
+        if (type == 3 && count == 1) {
+            putLittleEndian16(header, value);
+            putLittleEndian16(header, 0);
+        } else {
+            putLittleEndian32(header, value);
+        }
+    };
+    const uint32_t Short = 3, Long = 4, Rational = 5;
+    entry(256, Long, 1, uint32_t(width));                           // ImageWidth
+    entry(257, Long, 1, uint32_t(height));                          // ImageLength
+    entry(258, Short, 3, uint32_t(bitsOffset));                     // BitsPerSample
+    entry(259, Short, 1, 1);                                        // Compression: none
+    entry(262, Short, 1, 2);                                        // PhotometricInterpretation: RGB
+    entry(273, Long, uint32_t(strips), uint32_t(strips == 1 ? dataOffset : offsetsOffset));        // StripOffsets
+    entry(277, Short, 1, 3);                                        // SamplesPerPixel
+    entry(278, Long, 1, uint32_t(stripRows));                       // RowsPerStrip
+    entry(279, Long, uint32_t(strips), uint32_t(strips == 1 ? rowSize * height : countsOffset));   // StripByteCounts
+    entry(282, Rational, 1, uint32_t(resolutionOffset));            // XResolution
+    entry(283, Rational, 1, uint32_t(resolutionOffset + 8));        // YResolution
+    entry(284, Short, 1, 1);                                        // PlanarConfiguration: interleaved
+    entry(296, Short, 1, 2);                                        // ResolutionUnit: inch
+    putLittleEndian32(header, 0);                                   // No further directories
+
+    for (size_t ch = 0; ch < 3; ++ch) {
+        putLittleEndian16(header, 16);
+    }
+    for (size_t k = 0; k < 2; ++k) {
+        putLittleEndian32(header, 72);
+        putLittleEndian32(header, 1);
+    }
+    for (size_t s = 0; s < strips; ++s) {
+        putLittleEndian32(header, uint32_t(dataOffset + s * stripRows * rowSize));
+    }
+    for (size_t s = 0; s < strips; ++s) {
+        putLittleEndian32(header, uint32_t((std::min(height, (s + 1) * stripRows) - s * stripRows) * rowSize));
+    }
+
+    ThreadPool::get().parallelFor(strips, [&](size_t s) {
+        size_t i0 = s * stripRows,
+               i1 = std::min(i0 + stripRows, height);
+        std::vector<uint8_t> &out = parts[s + 1];
+        out.reserve((i1 - i0) * rowSize);
+        for (size_t k = i0 * 3 * width; k < i1 * 3 * width; ++k) {
+            putLittleEndian16(out, rgb16[k]);
+        }
+    });
+
+    return writeFile(filename, parts);
+}
+
+// Binary ".ppm" file with 16-bit RGB data, converted in parallel bands of rows
+bool encodePPM(const std::string &filename, const uint16_t *rgb16, size_t width, size_t height) {
+    size_t rowSize = 6 * width,
+           bandRows = std::max(size_t(1), BandSize / std::max(size_t(1), rowSize)),
+           bands = (height + bandRows - 1) / bandRows;
+
+    std::vector<std::vector<uint8_t>> parts(bands + 1);
+    std::string header = tfm::format("P6\n%d %d\n65535\n", width, height);
+    parts.front().assign(header.begin(), header.end());
+
+    // Samples are stored in big-endian byte order
+    ThreadPool::get().parallelFor(bands, [&](size_t band) {
+        size_t i0 = band * bandRows,
+               i1 = std::min(i0 + bandRows, height);
+        std::vector<uint8_t> &out = parts[band + 1];
+        out.reserve((i1 - i0) * rowSize);
+        for (size_t k = i0 * 3 * width; k < i1 * 3 * width; ++k) {
+            putBigEndian16(out, rgb16[k]);
+        }
+    });
+
+    return writeFile(filename, parts);
+}
+
+/* Scanline ".exr" file with B, G and R channels stored as half or full
+   floats. Blocks of 16 scanlines are ZIP compressed in parallel. */
+bool encodeEXR(const std::string &filename, const Image &image, bool half) {
+    const size_t linesPerBlock = 16;
+    size_t width  = image.getWidth(),
+           height = image.getHeight(),
+           sampleSize = half ? 2 : 4,
+           blocks = (height + linesPerBlock - 1) / linesPerBlock;
+    if (width == 0 || height == 0 || width > size_t(std::numeric_limits<int>::max()) ||
+        height > size_t(std::numeric_limits<int>::max())) {
+        return false;
+    }
+
+    std::vector<std::vector<uint8_t>> parts(blocks + 2);
+    std::vector<uint8_t> &header = parts.front();
+    const uint8_t magic[] = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 };
+    header.insert(header.end(), magic, magic + sizeof(magic));
+
+    auto attribute = [&](const char *name, const char *type, const std::vector<uint8_t> &value) {
+        header.insert(header.end(), name, name + strlen(name) + 1);
+        header.insert(header.end(), type, type + strlen(type) + 1);
+        putLittleEndian32(header, uint32_t(value.size()));
+        header.insert(header.end(), value.begin(), value.end());
+    };
+    auto putFloat = [](std::vector<uint8_t> &out, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        putLittleEndian32(out, bits);
+    };
+
+    // Channels are listed in alphabetical order
+    std::vector<uint8_t> channels;
+    for (const char *name : { "B", "G", "R" }) {
+        channels.push_back(uint8_t(name[0]));
+        channels.push_back(0);
+        putLittleEndian32(channels, half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT);
+        putLittleEndian32(channels, 0);     // pLinear and reserved bytes
+        putLittleEndian32(channels, 1);     // Sampling
+        putLittleEndian32(channels, 1);
+    }
+    channels.push_back(0);
+
+    std::vector<uint8_t> window;
+    putLittleEndian32(window, 0);
+    putLittleEndian32(window, 0);
+    putLittleEndian32(window, uint32_t(width - 1));
+    putLittleEndian32(window, uint32_t(height - 1));
+
+    std::vector<uint8_t> one, center;
+    putFloat(one, 1.f);
+    putFloat(center, 0.f);
+    putFloat(center, 0.f);
+
+    attribute("channels", "chlist", channels);
+    attribute("compression", "compression", { TINYEXR_COMPRESSIONTYPE_ZIP });
+    attribute("dataWindow", "box2i", window);
+    attribute("displayWindow", "box2i", window);
+    attribute("lineOrder", "lineOrder", { 0 });     // Increasing y
+    attribute("pixelAspectRatio", "float", one);
+    attribute("screenWindowCenter", "v2f", center);
+    attribute("screenWindowWidth", "float", one);
+    header.push_back(0);
+
+    ThreadPool::get().parallelFor(blocks, [&](size_t block) {
+        size_t i0 = block * linesPerBlock,
+               i1 = std::min(i0 + linesPerBlock, height),
+               lineSize = 3 * width * sampleSize;
+
+        // Each scanline stores all values of one channel after the other
+        std::vector<uint8_t> raw((i1 - i0) * lineSize);
+        for (size_t i = i0; i < i1; ++i) {
+            ConstPixelSpan pixels = image.row(i);
+            uint8_t *line = raw.data() + (i - i0) * lineSize;
+            for (size_t j = 0; j < width; ++j) {
+                Color3f c = pixels.get(j);
+                for (size_t k = 0; k < 3; ++k) {
+                    uint8_t *dst = line + (k * width + j) * sampleSize;
+                    float value = c[2 - k];
+                    if (half) {
+                        uint16_t bits = floatToHalf(value);
+                        dst[0] = uint8_t(bits);
+                        dst[1] = uint8_t(bits >> 8);
+                    } else {
+                        uint32_t bits;
+                        memcpy(&bits, &value, 4);
+                        for (size_t b = 0; b < 4; ++b) dst[b] = uint8_t(bits >> (8 * b));
+                    }
+                }
+            }
+        }
+
+        std::vector<uint8_t> compressed = compressEXRZip(raw);
+
+        std::vector<uint8_t> &out = parts[block + 2];
+        putLittleEndian32(out, uint32_t(i0));
+        putLittleEndian32(out, uint32_t(compressed.size()));
+        out.insert(out.end(), compressed.begin(), compressed.end());
+    });
+
+    // Table with the file offset of each block
+    std::vector<uint8_t> &offsets = parts[1];
+    uint64_t offset = header.size() + 8 * blocks;
+    for (size_t block = 0; block < blocks; ++block) {
+        putLittleEndian32(offsets, uint32_t(offset));
+        putLittleEndian32(offsets, uint32_t(offset >> 32));
+        offset += parts[block + 2].size();
+    }
+
+    return writeFile(filename, parts);
+}
+
+// Binary ".pfm" file with little-endian RGB floats, rows from bottom to top
+bool encodePFM(const std::string &filename, const Image &image) {
+    size_t width  = image.getWidth(),
+           height = image.getHeight(),
+           rowSize = 12 * width,
+           bandRows = std::max(size_t(1), BandSize / std::max(size_t(1), rowSize)),
+           bands = (height + bandRows - 1) / bandRows;
+
+    std::vector<std::vector<uint8_t>> parts(bands + 1);
+    std::string header = tfm::format("PF\n%d %d\n-1.0\n", width, height);
+    parts.front().assign(header.begin(), header.end());
+
+    ThreadPool::get().parallelFor(bands, [&](size_t band) {
+        size_t r0 = band * bandRows,
+               r1 = std::min(r0 + bandRows, height);
+        std::vector<uint8_t> &out = parts[band + 1];
+        out.reserve((r1 - r0) * rowSize);
+        for (size_t r = r0; r < r1; ++r) {
+            ConstPixelSpan pixels = image.row(height - 1 - r);
+            for (size_t j = 0; j < width; ++j) {
+                Color3f c = pixels.get(j);
+                for (size_t ch = 0; ch < 3; ++ch) {
+                    uint32_t bits;
+                    memcpy(&bits, &c[ch], 4);
+                    putLittleEndian32(out, bits);
+                }
+            }
+        }
+    });
+
+    return writeFile(filename, parts);
+}
+
+// Headerless ".raw" file with interleaved RGB floats (or half floats) in native byte order
+bool encodeRaw(const std::string &filename, const Image &image, bool half) {
+    size_t width  = image.getWidth(),
+           height = image.getHeight(),
+           sampleSize = half ? 2 : 4,
+           rowSize = 3 * sampleSize * width,
+           bandRows = std::max(size_t(1), BandSize / std::max(size_t(1), rowSize)),
+           bands = (height + bandRows - 1) / bandRows;
+
+    std::vector<std::vector<uint8_t>> parts(bands);
+    ThreadPool::get().parallelFor(bands, [&](size_t band) {
+        size_t i0 = band * bandRows,
+               i1 = std::min(i0 + bandRows, height);
+        std::vector<uint8_t> &out = parts[band];
+        out.resize((i1 - i0) * rowSize);
+        uint8_t *dst = out.data();
+        for (size_t i = i0; i < i1; ++i) {
+            ConstPixelSpan pixels = image.row(i);
+            for (size_t j = 0; j < width; ++j) {
+                Color3f c = pixels.get(j);
+                for (size_t ch = 0; ch < 3; ++ch, dst += sampleSize) {
+                    if (half) {
+                        uint16_t bits = floatToHalf(c[ch]);
+                        memcpy(dst, &bits, 2);
+                    } else {
+                        memcpy(dst, &c[ch], 4);
+                    }
+                }
+            }
+        }
+    });
+
+    return writeFile(filename, parts);
+}
+
+} // Namespace tonemapper
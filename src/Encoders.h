@@ -0,0 +1,42 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <Image.h>
+
+namespace tonemapper {
+
+/* File encoders behind `Image::save` and `Image::saveLDR`. All of them split
+   the image into bands that are encoded in parallel, write to standard output
+   for the filename "-", and return false if the file could not be written.
+   LDR data is interleaved RGB. */
+bool encodePNG(const std::string &filename, const void *pixels, size_t width, size_t height,
+               int bitDepth, int level);
+bool encodeJPEG(const std::string &filename, const uint8_t *rgb8, size_t width, size_t height,
+                int quality, ChromaSubsampling subsampling);
+bool encodeTIFF(const std::string &filename, const uint16_t *rgb16, size_t width, size_t height);
+bool encodePPM(const std::string &filename, const uint16_t *rgb16, size_t width, size_t height);
+bool encodeEXR(const std::string &filename, const Image &image, bool half);
+bool encodePFM(const std::string &filename, const Image &image);
+bool encodeRaw(const std::string &filename, const Image &image, bool half);
+
+/* Checksums and compression of the miniz copy inside tinyexr. Its
+   implementation is compiled into Image.cpp, so the encoders reach it
+   through these functions. */
+uint32_t zlibCRC32(uint32_t crc, const uint8_t *data, size_t size);
+uint32_t zlibAdler32(uint32_t adler, const uint8_t *data, size_t size);
+
+/* Append the raw deflate stream of `size` bytes to `out`. It ends with the
+   final block if `last` is set, else with a full flush so that the stream of
+   the next data can follow. Level 1 only compresses runs. */
+bool zlibDeflate(const uint8_t *data, size_t size, int level, bool last, std::vector<uint8_t> &out);
+
+// Block of a ZIP compressed ".exr" file, with the byte reordering and predictor of the format
+std::vector<uint8_t> compressEXRZip(const std::vector<uint8_t> &raw);
+
+} // Namespace tonemapper
@@ -8,6 +8,7 @@
 #include <Gui.h>
 
 #include <Image.h>
+#include <Pipeline.h>
 #include <Tonemap.h>
 
 #include <nanogui/button.h>
@@ -27,6 +28,7 @@
 #include <nanogui/window.h>
 #include <nanogui/vscrollpanel.h>
 
+#include <memory>
 #include <thread>
 #include <filesystem>
 
@@ -112,9 +114,11 @@ TonemapperGui::TonemapperGui()
 
     m_saveButton = new Button(m_mainWindow, "Save LDR image", FA_SAVE);
     m_saveButton->set_background_color(Color(0, 0, 255, 25));
-    m_saveButton->set_tooltip("Save LDR image (.png or .jpg)");
+    m_saveButton->set_tooltip("Save tonemapped image (.png, .jpg, .tif, .ppm or .exr)");
     m_saveButton->set_callback([&] {
-        std::string filename = file_dialog({ {"jpg", "JPEG"}, {"png", "Portable Network Graphics"} }, true);
+        std::string filename = file_dialog({ {"jpg", "JPEG"}, {"png", "Portable Network Graphics"},
+                                             {"tif", "16-bit TIFF"}, {"ppm", "16-bit Portable Pixmap"},
+                                             {"exr", "OpenEXR"} }, true);
         if (m_image && filename != "") {
             m_saveWindow = new Window(this, "Saving tonemapped image ..");
             m_saveWindow->set_layout(new BoxLayout(Orientation::Vertical, Alignment::Middle, 10, 10));
@@ -130,14 +134,18 @@ TonemapperGui::TonemapperGui()
             m_saveProgressBar = new ProgressBar(panel);
             m_saveProgressBar->set_fixed_width(200);
 
-            m_saveThread = new std::thread([&, filename]{
+            /* The thread saves a copy of the operator, as the parameters of
+               the displayed one can be edited in the meantime. */
+            std::unique_ptr<TonemapOperator> op(TonemapOperator::clone(TonemapOperator::orderedNames()[m_tonemapOperatorIndex],
+                                                                       m_operators[m_tonemapOperatorIndex]));
+            op->updateParameters();
+            float exposure = m_exposure;
+
+            m_saveThread = new std::thread([&, filename, exposure, op = std::move(op)]{
                 PRINT_("Save image \"%s\" ..", filename);
-                Image *out = new Image(m_image->getWidth(), m_image->getHeight());
                 m_saveProgress = 0.f;
-                m_operators[m_tonemapOperatorIndex]->process(m_image, out, m_exposure, &m_saveProgress);
-                out->save(filename);
+                tonemapToFile(*op, *m_image, exposure, filename, SaveOptions(), &m_saveProgress);
                 m_saveProgress = -1.f;
-                delete out;
                 PRINT(" done.");
             });
         }
@@ -382,6 +390,7 @@ void TonemapperGui::setTonemapOperator(int index) {
 
     TonemapOperator *op = m_operators[m_tonemapOperatorIndex];
     op->preprocess(m_image);
+    op->updateParameters();
     m_shader = new Shader(m_renderPass, op->name, op->vertexShader, op->fragmentShader);
     m_shader->set_uniform("exposure", 1.f);
     for (auto &parameter : op->parameters) {
@@ -540,6 +549,9 @@ void TonemapperGui::setTonemapOperator(int index) {
 }
 
 void TonemapperGui::refreshGraph() {
+    // Called whenever the parameters changed
+    m_operators[m_tonemapOperatorIndex]->updateParameters();
+
     m_graphWindow->set_visible(true);
 
     if (m_graph) {
@@ -684,7 +696,8 @@ void TonemapperGui::draw_contents() {
     m_renderPass->begin();
 
     if (m_image && m_texture) {
-        m_texture->upload((const uint8_t *)m_image->getData());
+        const Image *image = m_image;
+        m_texture->upload((const uint8_t *)image->getData());
 
         float scale = m_pixel_ratio * std::pow(1.1f, m_imageDisplayScale);
         GLint x = GLint((m_fbsize[0] - scale*m_imageDisplayWidth)  / 2 + m_pixel_ratio*m_imageDisplayOffsetX);
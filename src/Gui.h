@@ -11,6 +11,7 @@
 
 #include <nanogui/screen.h>
 
+#include <atomic>
 #include <thread>
 
 namespace tonemapper {
@@ -62,7 +63,7 @@ private:
     nanogui::ref<nanogui::Button>      m_saveButton;
     nanogui::ref<nanogui::Window>      m_saveWindow;
     nanogui::ref<nanogui::ProgressBar> m_saveProgressBar;
-    float                              m_saveProgress = 0.f;
+    std::atomic<float>                 m_saveProgress{0.f};
     std::thread                       *m_saveThread = nullptr;
 
     nanogui::ref<nanogui::Label>       m_exposureLabel;
@@ -0,0 +1,72 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace tonemapper {
+
+/* Conversions between float and IEEE 754 half precision values (stored as
+   `uint16_t`), including denormals, infinities and NaNs. See "half <-> float
+   conversions" by Fabian Giesen for the bit tricks used here. */
+
+inline float halfToFloat(uint16_t h) {
+    const uint32_t shiftedExponent = 0x7c00 << 13;
+    uint32_t bits = uint32_t(h & 0x7fff) << 13,
+             exponent = bits & shiftedExponent;
+    bits += (127 - 15) << 23;
+
+    float result;
+    if (exponent == shiftedExponent) {
+        // Infinity or NaN
+        bits += (128 - 16) << 23;
+        std::memcpy(&result, &bits, 4);
+    } else if (exponent == 0) {
+        // Denormal, renormalize with a float subtraction
+        bits += 1 << 23;
+        std::memcpy(&result, &bits, 4);
+        result -= 6.103515625e-05f;   // 2^-14
+    } else {
+        std::memcpy(&result, &bits, 4);
+    }
+
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    std::memcpy(&bits, &result, 4);
+    bits |= sign;
+    std::memcpy(&result, &bits, 4);
+    return result;
+}
+
+// Round to nearest even, values that are too large become infinity
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint16_t result;
+    if (bits >= (127 + 16) << 23) {
+        // Infinity, NaN or too large
+        result = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+    } else if (bits < (127 - 14) << 23) {
+        // Denormal or zero, let a float addition do the rounding
+        float f;
+        std::memcpy(&f, &bits, 4);
+        f += 0.5f;
+        std::memcpy(&bits, &f, 4);
+        result = uint16_t(bits - 0x3f000000u);
+    } else {
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += (uint32_t(15 - 127) << 23) + 0xfff + mantissaOdd;
+        result = uint16_t(bits >> 13);
+    }
+    return uint16_t(result | (sign >> 16));
+}
+
+} // Namespace tonemapper
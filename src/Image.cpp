@@ -6,12 +6,21 @@
 */
 
 #include <Image.h>
+#include <Encoders.h>
+#include <MappedFile.h>
+#include <Parallel.h>
+#include <Simd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <limits>
 #include <filesystem>
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#endif
 
 #ifndef TONEMAPPER_BUILD_GUI
     // This definition is already done as part of nanogui
@@ -20,155 +29,1849 @@
 #include <stb_image.h>
 
 #define TINYEXR_IMPLEMENTATION
+// Decompress the chunks of EXR files on several threads
+#define TINYEXR_USE_THREAD 1
 #include <tinyexr.h>
 
 namespace tonemapper {
 
-Image::Image(size_t width, size_t height)
-    : m_width(width), m_height(height) {
-    m_pixels = std::unique_ptr<Color3f[]>(new Color3f[m_width * m_height]);
+namespace {
+
+// Alignment (in bytes) of the planes and rows of planar images, one cache line
+constexpr size_t PlaneAlignment = 64;
+
+/* Allocate three planes of `planeSize` values each, with the first one
+   aligned to `PlaneAlignment` bytes. */
+template <typename T>
+std::unique_ptr<T[]> allocatePlanes(size_t planeSize, T *planes[3]) {
+    constexpr size_t alignment = PlaneAlignment / sizeof(T);
+
+    // Over-allocate so that the first plane can be aligned
+    std::unique_ptr<T[]> storage(new T[3 * planeSize + alignment]());
+    size_t misalignment = (uintptr_t(storage.get()) / sizeof(T)) % alignment;
+    T *first = storage.get() + (alignment - misalignment) % alignment;
+    for (size_t ch = 0; ch < 3; ++ch) {
+        planes[ch] = first + ch * planeSize;
+    }
+    return storage;
 }
 
-Image::~Image() {}
+} // Anonymous namespace
 
-Image *loadFromEXR(const std::string &filename) {
-    const char *filename_c = filename.c_str();
-    const char *err = nullptr;
+Image::Image(size_t width, size_t height, PixelLayout layout)
+    : m_width(width), m_height(height), m_layout(layout) {
+    if (m_layout == PixelLayout::Interleaved) {
+        m_pixelStorage = std::unique_ptr<Color3f[]>(new Color3f[m_width * m_height]);
+        m_pixels = m_pixelStorage.get();
+    } else if (m_layout == PixelLayout::Planar) {
+        size_t alignment = PlaneAlignment / sizeof(float);
+        m_rowStride = (m_width + alignment - 1) / alignment * alignment;
+        m_planeStorage = allocatePlanes(m_rowStride * m_height, m_planes);
+    } else {
+        size_t alignment = PlaneAlignment / sizeof(uint16_t);
+        m_rowStride = (m_width + alignment - 1) / alignment * alignment;
+        m_halfStorage = allocatePlanes(m_rowStride * m_height, m_halfPlanes);
+    }
+}
 
-    EXRVersion version;
-    EXRHeader header;
-    InitEXRHeader(&header);
+Image::Image(size_t width, size_t height, Color3f *pixels, std::function<void()> release)
+    : m_width(width), m_height(height), m_layout(PixelLayout::Interleaved),
+      m_pixels(pixels), m_release(std::move(release)) {}
+
+Image::Image(size_t width, size_t height, float *const planes[3], size_t rowStride, std::function<void()> release)
+    : m_width(width), m_height(height), m_layout(PixelLayout::Planar),
+      m_planes{planes[0], planes[1], planes[2]}, m_rowStride(rowStride), m_release(std::move(release)) {}
+
+Image::Image(size_t width, size_t height, uint16_t *const planes[3], size_t rowStride, std::function<void()> release)
+    : m_width(width), m_height(height), m_layout(PixelLayout::PlanarHalf),
+      m_halfPlanes{planes[0], planes[1], planes[2]}, m_rowStride(rowStride), m_release(std::move(release)) {}
+
+Image::~Image() {
+    if (m_release) {
+        m_release();
+    }
+}
+
+void Image::setLayout(PixelLayout layout) {
+    if (layout == m_layout) {
+        return;
+    }
+
+    Image converted(m_width, m_height, layout);
+    for (size_t i = 0; i < m_height; ++i) {
+        ConstPixelSpan src = row(i);
+        PixelSpan dst = converted.row(i);
+        for (size_t j = 0; j < m_width; ++j) {
+            dst.set(j, src.get(j));
+        }
+    }
+
+    // The converted pixels are always owned by the image
+    if (m_release) {
+        m_release();
+        m_release = nullptr;
+    }
+
+    m_layout       = layout;
+    m_pixelStorage = std::move(converted.m_pixelStorage);
+    m_pixels       = converted.m_pixels;
+    m_planeStorage = std::move(converted.m_planeStorage);
+    m_halfStorage  = std::move(converted.m_halfStorage);
+    m_rowStride    = converted.m_rowStride;
+    for (size_t ch = 0; ch < 3; ++ch) {
+        m_planes[ch]     = converted.m_planes[ch];
+        m_halfPlanes[ch] = converted.m_halfPlanes[ch];
+    }
+}
+
+namespace {
+
+/* Part of an image that `LoadOptions` asks for: the region of interest,
+   clamped to the image, and the factor it is downsampled by. The region is
+   invalid if it starts outside of the image. */
+struct Reduction {
+    Reduction(const LoadOptions &options, size_t imageWidth, size_t imageHeight) {
+        valid = options.roiX < imageWidth && options.roiY < imageHeight;
+        x0 = std::min(options.roiX, imageWidth  - 1);
+        y0 = std::min(options.roiY, imageHeight - 1);
+        width  = options.roiWidth  > 0 ? std::min(options.roiWidth,  imageWidth  - x0) : imageWidth  - x0;
+        height = options.roiHeight > 0 ? std::min(options.roiHeight, imageHeight - y0) : imageHeight - y0;
+        factor = std::max(options.downsample, size_t(1));
+        outWidth  = (width  + factor - 1) / factor;
+        outHeight = (height + factor - 1) / factor;
+        identity = x0 == 0 && y0 == 0 && width == imageWidth && height == imageHeight && factor == 1;
+    }
 
-    if (ParseEXRVersionFromFile(&version, filename_c) != 0 ||
-        ParseEXRHeaderFromFile(&header, &version, filename_c, &err) != 0) {
-        ERROR("Bitmap(): Could not parse EXR file \"%s\". %s", filename, err);
-        // FreeEXRErrorMessage(err);
+    /* Source pixels [first, last) of the region (along an axis of `size`
+       pixels) that are averaged for output pixel `k`, never empty */
+    void block(size_t k, size_t size, size_t &first, size_t &last) const {
+        first = std::min(k * factor, size - 1);
+        last  = std::max(std::min(first + factor, size), first + 1);
     }
 
+    size_t x0, y0, width, height;   // Region of interest
+    size_t factor;                  // Downsampling factor
+    size_t outWidth, outHeight;     // Resolution of the result
+    bool identity;                  // The whole image at full resolution
+    bool valid;
+};
+
+void checkRegion(const Reduction &reduction, const std::string &filename) {
+    if (!reduction.valid) {
+        ERROR("Bitmap(): The region of interest starts outside of image \"%s\".", filename);
+    }
+}
+
+/* Compute rows [first, last) of `result`, the image described by `r`, from
+   rows of the source image. `readRow(i, dst)` writes the `r.width` pixels of
+   source row `i` that start at column `r.x0`. Without downsampling, rows are
+   read straight into the result. Otherwise each pixel is the average of a
+   block of `factor` x `factor` source pixels (fewer at the right and bottom
+   border), and only one source row is kept in memory per thread. */
+template <typename ReadRow>
+void reduceRowRange(const Reduction &r, Image &result, size_t first, size_t last, ReadRow readRow) {
+    if (r.factor == 1 && r.outWidth == r.width && r.outHeight == r.height) {
+        ThreadPool::get().parallelFor(last - first, [&](size_t i) {
+            readRow(r.y0 + first + i, result.row(first + i));
+        });
+        return;
+    }
+
+    ThreadPool::get().parallelFor(last - first, [&](size_t i) {
+        Image line(r.width, 1, PixelLayout::Planar);
+        PixelSpan src = line.row(0);
+        // Sums in double precision, blocks can be large for thumbnails
+        std::vector<double> sums(3 * r.outWidth, 0.0);
+        size_t firstRow, lastRow;
+        r.block(first + i, r.height, firstRow, lastRow);
+        for (size_t k = firstRow; k < lastRow; ++k) {
+            readRow(r.y0 + k, src);
+            for (size_t j = 0; j < r.outWidth; ++j) {
+                size_t firstColumn, lastColumn;
+                r.block(j, r.width, firstColumn, lastColumn);
+                for (size_t l = firstColumn; l < lastColumn; ++l) {
+                    Color3f c = src.get(l);
+                    sums[3 * j]     += c.r();
+                    sums[3 * j + 1] += c.g();
+                    sums[3 * j + 2] += c.b();
+                }
+            }
+        }
+
+        PixelSpan dst = result.row(first + i);
+        for (size_t j = 0; j < r.outWidth; ++j) {
+            size_t firstColumn, lastColumn;
+            r.block(j, r.width, firstColumn, lastColumn);
+            double count = double((lastColumn - firstColumn) * (lastRow - firstRow));
+            dst.set(j, Color3f(float(sums[3 * j] / count), float(sums[3 * j + 1] / count), float(sums[3 * j + 2] / count)));
+        }
+    });
+}
+
+// Same for the whole result, which is allocated with the given layout
+template <typename ReadRow>
+Image *reduceRows(const Reduction &r, PixelLayout layout, ReadRow readRow) {
+    std::unique_ptr<Image> result(new Image(r.outWidth, r.outHeight, layout));
+    reduceRowRange(r, *result, 0, r.outHeight, readRow);
+    return result.release();
+}
+
+// Reduce an image that was decoded in full
+Image *reduceImage(const Image &image, const Reduction &r, PixelLayout layout) {
+    return reduceRows(r, layout, [&](size_t i, const PixelSpan &dst) {
+        ConstPixelSpan src = image.row(i, r.x0);
+        for (size_t j = 0; j < r.width; ++j) {
+            dst.set(j, src.get(j));
+        }
+    });
+}
+
+// Value of the "name" attribute of a part in a multi-part EXR file
+std::string partName(const EXRHeader &header) {
+    for (int i = 0; i < header.num_custom_attributes; ++i) {
+        const EXRAttribute &attribute = header.custom_attributes[i];
+        if (strcmp(attribute.name, "name") == 0) {
+            std::string name((const char *) attribute.value, size_t(attribute.size));
+            return name.substr(0, name.find('\0'));
+        }
+    }
+    return "";
+}
+
+/* tinyexr only reads the tile description of multi-part files if the file as
+   a whole is flagged as tiled, which is never the case. Recover it from the
+   "tiles" attribute instead. */
+void readTileDescription(EXRHeader &header) {
+    for (int i = 0; i < header.num_custom_attributes; ++i) {
+        const EXRAttribute &attribute = header.custom_attributes[i];
+        if (strcmp(attribute.name, "tiles") == 0 && attribute.size >= 9) {
+            unsigned int size[2];
+            memcpy(size, attribute.value, 8);
+            tinyexr::swap4(&size[0]);
+            tinyexr::swap4(&size[1]);
+            header.tiled              = 1;
+            header.tile_size_x        = int(size[0]);
+            header.tile_size_y        = int(size[1]);
+            header.tile_level_mode    = attribute.value[8] & 0xf;
+            header.tile_rounding_mode = attribute.value[8] >> 4;
+        }
+    }
+}
+
+// Index of the part selected by `part` (either a name or an index), or -1
+int findPart(EXRHeader **headers, int count, const std::string &part) {
+    if (part.empty()) {
+        return 0;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (partName(*headers[i]) == part) {
+            return i;
+        }
+    }
+    if (part.find_first_not_of("0123456789") == std::string::npos) {
+        int index = std::atoi(part.c_str());
+        if (index < count) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+// Resolution of a level of a tiled EXR image, given the one of level 0
+int levelSize(int size, int level, int rounding) {
+    int result = rounding == TINYEXR_TILE_ROUND_UP ? (size + (1 << level) - 1) >> level : size >> level;
+    return std::max(result, 1);
+}
+
+// Number of levels of a tiled EXR image along an axis of `size` pixels
+int levelCount(int size, int rounding) {
+    int levels = 1;
+    while (levelSize(size, levels - 1, rounding) > 1) {
+        levels++;
+    }
+    return levels;
+}
+
+// Number of chunks of an EXR image, including the tiles of all levels
+size_t chunkCount(const EXRHeader &header) {
+    int width  = header.data_window[2] - header.data_window[0] + 1,
+        height = header.data_window[3] - header.data_window[1] + 1;
+    if (!header.tiled) {
+        int lines = header.compression_type == TINYEXR_COMPRESSIONTYPE_ZIP ? 16 :
+                    header.compression_type == TINYEXR_COMPRESSIONTYPE_PIZ ? 32 :
+                    header.compression_type == TINYEXR_COMPRESSIONTYPE_ZFP ? 16 : 1;
+        return size_t((height + lines - 1) / lines);
+    }
+
+    auto tiles = [&](int lx, int ly) {
+        int rounding = header.tile_rounding_mode;
+        return size_t((levelSize(width,  lx, rounding) + header.tile_size_x - 1) / header.tile_size_x) *
+               size_t((levelSize(height, ly, rounding) + header.tile_size_y - 1) / header.tile_size_y);
+    };
+    size_t count = 0;
+    if (header.tile_level_mode == TINYEXR_TILE_MIPMAP_LEVELS) {
+        int levels = levelCount(std::max(width, height), header.tile_rounding_mode);
+        for (int l = 0; l < levels; ++l) {
+            count += tiles(l, l);
+        }
+    } else if (header.tile_level_mode == TINYEXR_TILE_RIPMAP_LEVELS) {
+        for (int ly = 0; ly < levelCount(height, header.tile_rounding_mode); ++ly) {
+            for (int lx = 0; lx < levelCount(width, header.tile_rounding_mode); ++lx) {
+                count += tiles(lx, ly);
+            }
+        }
+    } else {
+        count = tiles(0, 0);
+    }
+    return count;
+}
+
+/* Offsets of all chunks of a single-part EXR file. Returns false if the
+   offset table is damaged. */
+bool readChunkOffsets(const EXRHeader &header, const unsigned char *memory, size_t size,
+                      std::vector<tinyexr::tinyexr_uint64> &offsets) {
+    size_t count = header.chunk_count > 0 ? size_t(header.chunk_count) : chunkCount(header);
+    const unsigned char *marker = memory + 8 + header.header_len;
+    if (size_t(header.header_len) + 8 > size || (size - header.header_len - 8) / 8 < count) {
+        return false;
+    }
+
+    offsets.resize(count);
+    for (size_t c = 0; c < count; ++c, marker += 8) {
+        memcpy(&offsets[c], marker, 8);
+        tinyexr::swap8(&offsets[c]);
+        if (offsets[c] < 8 || offsets[c] >= size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Offsets of the first `chunkCount` chunks of part `part` in the multi-part
+   EXR file in `memory`. They point past the part number that each chunk
+   starts with. */
+int readPartOffsets(EXRHeader **headers, int count, int part, size_t chunkCount,
+                    const unsigned char *memory, size_t size,
+                    std::vector<tinyexr::tinyexr_uint64> &offsets, std::string *err) {
+    size_t headerSize = 0;
+    for (int i = 0; i < count; ++i) {
+        headerSize += headers[i]->header_len;
+    }
+
+    // Magic number, version, headers and the empty header that terminates them
+    const unsigned char *marker = memory + 8 + headerSize + 1;
+    for (int i = 0; i < part; ++i) {
+        marker += 8 * size_t(headers[i]->chunk_count);
+    }
+
+    if (marker + 8 * chunkCount > memory + size) {
+        *err = "Insufficient data size in offset table.";
+        return TINYEXR_ERROR_INVALID_DATA;
+    }
+
+    offsets.resize(chunkCount);
+    for (size_t c = 0; c < chunkCount; ++c, marker += 8) {
+        tinyexr::tinyexr_uint64 offset;
+        memcpy(&offset, marker, 8);
+        tinyexr::swap8(&offset);
+        if (offset + 4 >= size) {
+            *err = "Invalid offset in EXR chunk offset table.";
+            return TINYEXR_ERROR_INVALID_DATA;
+        }
+
+        // Each chunk starts with the number of the part it belongs to
+        unsigned int partNumber;
+        memcpy(&partNumber, memory + offset, 4);
+        tinyexr::swap4(&partNumber);
+        if (partNumber != unsigned(part)) {
+            *err = "Invalid part number in EXR chunk.";
+            return TINYEXR_ERROR_INVALID_DATA;
+        }
+        offsets[c] = offset + 4;
+    }
+    return TINYEXR_SUCCESS;
+}
+
+/* Decode only part `part` of the multi-part EXR file in `memory`. Unlike
+   `LoadEXRMultipartImageFromMemory`, the chunks of all other parts are
+   skipped. */
+int decodeEXRPart(EXRImage *image, EXRHeader **headers, int count, int part,
+                  const unsigned char *memory, size_t size, std::string *err) {
+    const EXRHeader *header = headers[part];
+    size_t chunkCount = size_t(header->chunk_count);
+    if (header->tiled && header->tile_level_mode != TINYEXR_TILE_ONE_LEVEL) {
+        // Only the full resolution level is needed, its tiles come first
+        int width  = header->data_window[2] - header->data_window[0] + 1,
+            height = header->data_window[3] - header->data_window[1] + 1;
+        chunkCount = size_t((width  + header->tile_size_x - 1) / header->tile_size_x) *
+                     size_t((height + header->tile_size_y - 1) / header->tile_size_y);
+    }
+
+    std::vector<tinyexr::tinyexr_uint64> offsets;
+    if (int ret = readPartOffsets(headers, count, part, chunkCount, memory, size, offsets, err)) {
+        return ret;
+    }
+    return tinyexr::DecodeChunk(image, header, offsets, memory, size, err);
+}
+
+/* Half channels are converted to float while decoding, unless the image keeps
+   them as half anyway. */
+void requestPixelTypes(EXRHeader &header, PixelLayout layout) {
     for (int i = 0; i < header.num_channels; ++i) {
-        if (header.requested_pixel_types[i] == TINYEXR_PIXELTYPE_HALF) {
+        if (header.requested_pixel_types[i] == TINYEXR_PIXELTYPE_HALF && layout != PixelLayout::PlanarHalf) {
             header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
         }
     }
+}
 
-    EXRImage img;
-    InitEXRImage(&img);
-    if (LoadEXRImageFromFile(&img, &header, filename_c, &err) != 0) {
-        ERROR("Bitmap(): Could not open EXR file \"%s\". %s", filename, err);
-        // FreeEXRErrorMessage(err);
+/* Source channel of each of R, G and B in an EXR image, or -1 for channels
+   that stay black. `selection` is given by `LoadOptions::channels`. Without
+   it, the "R", "G" and "B" channels are used if there are any, or else the
+   ".R", ".G" and ".B" channels of the first layer that has all three. Other
+   images (and those with fewer than three channels) are read as gray, from
+   "Y" or their first channel. Returns false with a message in `err` if the
+   selected channels do not exist. */
+bool selectChannels(const EXRHeader &header, const std::string &selection, int chIdx[3], std::string *err) {
+    auto find = [&](const std::string &name) {
+        for (int c = 0; c < header.num_channels; ++c) {
+            if (name == header.channels[c].name) return c;
+        }
+        return -1;
+    };
+
+    if (!selection.empty()) {
+        std::vector<std::string> names;
+        for (size_t start = 0, end = 0; end != std::string::npos; start = end + 1) {
+            end = selection.find(',', start);
+            names.push_back(selection.substr(start, end == std::string::npos ? end : end - start));
+        }
+        bool layer = names.size() == 1;
+        if (layer) {
+            // A single channel, or else a layer
+            if (int c = find(names[0]); c >= 0) {
+                chIdx[0] = chIdx[1] = chIdx[2] = c;
+                return true;
+            }
+            names = { names[0] + ".R", names[0] + ".G", names[0] + ".B" };
+        }
+        if (names.size() != 3) {
+            *err = "Expected one or three channels instead of \"" + selection + "\".";
+            return false;
+        }
+        for (int ch = 0; ch < 3; ++ch) {
+            chIdx[ch] = find(names[ch]);
+            if (chIdx[ch] < 0) {
+                *err = layer ? "There is no channel or layer \"" + selection + "\", channels are" :
+                               "There is no channel \"" + names[ch] + "\", channels are";
+                for (int c = 0; c < header.num_channels; ++c) {
+                    *err += std::string(c == 0 ? " \"" : ", \"") + header.channels[c].name + "\"";
+                }
+                *err += ".";
+                return false;
+            }
+        }
+        return true;
     }
 
-    Image *result = new Image(img.width, img.height);
+    if (header.num_channels >= 3) {
+        chIdx[0] = find("R");
+        chIdx[1] = find("G");
+        chIdx[2] = find("B");
+        if (chIdx[0] >= 0 || chIdx[1] >= 0 || chIdx[2] >= 0) {
+            return true;
+        }
+        for (int c = 0; c < header.num_channels; ++c) {
+            std::string name = header.channels[c].name;
+            if (name.size() > 2 && name.compare(name.size() - 2, 2, ".R") == 0) {
+                std::string layer = name.substr(0, name.size() - 2);
+                chIdx[0] = c;
+                chIdx[1] = find(layer + ".G");
+                chIdx[2] = find(layer + ".B");
+                if (chIdx[1] >= 0 && chIdx[2] >= 0) {
+                    return true;
+                }
+            }
+        }
+    }
+    chIdx[0] = chIdx[1] = chIdx[2] = std::max(find("Y"), 0);
+    return true;
+}
+
+/* Raw EXR channel values, either read from the file itself (`FileOrder`, in
+   little-endian byte order) or from data decoded by tinyexr (native order). */
+template <bool FileOrder>
+inline uint16_t readHalfBits(const unsigned char *p) {
+    unsigned short value;
+    memcpy(&value, p, 2);
+    if (FileOrder) tinyexr::swap2(&value);
+    return value;
+}
+
+template <bool FileOrder>
+inline uint32_t readWord(const unsigned char *p) {
+    unsigned int value;
+    memcpy(&value, p, 4);
+    if (FileOrder) tinyexr::swap4(&value);
+    return value;
+}
+
+/* Copy `n` consecutive values of an EXR channel that is stored as `type` into
+   channel `ch` of `dst`. The pixel type and the destination are resolved once
+   per call, so the loops themselves do not branch. */
+template <bool FileOrder>
+void copyEXRChannel(const unsigned char *src, int type, const PixelSpan &dst, size_t ch, size_t n) {
+    auto copy = [&](auto *out, size_t stride, size_t size, auto convert) {
+        for (size_t j = 0; j < n; ++j) {
+            out[j * stride] = convert(src + j * size);
+        }
+    };
+    auto readFloat = [](const unsigned char *p) {
+        uint32_t bits = readWord<FileOrder>(p);
+        float value;
+        memcpy(&value, &bits, 4);
+        return value;
+    };
+    auto readUint = [](const unsigned char *p) { return float(int32_t(readWord<FileOrder>(p))); };
+
+    if (dst.isHalf()) {
+        uint16_t *out = dst.halfChannels[ch];
+        if (type == TINYEXR_PIXELTYPE_HALF) {
+            copy(out, 1, 2, readHalfBits<FileOrder>);
+        } else if (type == TINYEXR_PIXELTYPE_FLOAT) {
+            copy(out, 1, 4, [&](const unsigned char *p) { return floatToHalf(readFloat(p)); });
+        } else {
+            copy(out, 1, 4, [&](const unsigned char *p) { return floatToHalf(readUint(p)); });
+        }
+    } else {
+        float *out = dst.channels[ch];
+        if (type == TINYEXR_PIXELTYPE_HALF) {
+            copy(out, dst.stride, 2, [](const unsigned char *p) { return halfToFloat(readHalfBits<FileOrder>(p)); });
+        } else if (type == TINYEXR_PIXELTYPE_FLOAT) {
+            copy(out, dst.stride, 4, readFloat);
+        } else {
+            copy(out, dst.stride, 4, readUint);
+        }
+    }
+}
+
+/* Turn a decoded EXR image (scanline or tiled) into an `Image`. Scanline
+   images come as one plane per channel. If the RGB planes already have the
+   type of the requested layout, the result takes them over from `img`
+   instead of copying them. `chIdx` gives the channels that are read, see
+   `selectChannels`. */
+Image *convertEXR(const EXRHeader &header, EXRImage &img, const int chIdx[3], PixelLayout layout) {
+    int width  = header.data_window[2] - header.data_window[0] + 1,
+        height = header.data_window[3] - header.data_window[1] + 1;
+
+    int planeType = layout == PixelLayout::Planar     ? TINYEXR_PIXELTYPE_FLOAT :
+                    layout == PixelLayout::PlanarHalf ? TINYEXR_PIXELTYPE_HALF : -1;
+    bool adopt = !img.tiles && chIdx[0] != chIdx[1] && chIdx[1] != chIdx[2] && chIdx[0] != chIdx[2];
+    for (int ch = 0; ch < 3; ++ch) {
+        adopt &= chIdx[ch] >= 0 && header.pixel_types[chIdx[ch]] == planeType;
+    }
+    if (adopt) {
+        // Leave an empty image behind, so freeing `img` does not free the planes
+        EXRImage *owned = new EXRImage(img);
+        InitEXRImage(&img);
+        auto release = [owned]() {
+            FreeEXRImage(owned);
+            delete owned;
+        };
+
+        if (layout == PixelLayout::Planar) {
+            float *planes[3];
+            for (int ch = 0; ch < 3; ++ch) planes[ch] = (float *) owned->images[chIdx[ch]];
+            return new Image(width, height, planes, size_t(width), release);
+        }
+        uint16_t *planes[3];
+        for (int ch = 0; ch < 3; ++ch) planes[ch] = (uint16_t *) owned->images[chIdx[ch]];
+        return new Image(width, height, planes, size_t(width), release);
+    }
+
+    Image *result = new Image(width, height, layout);
+
+    // Copy `n` pixels starting at `offset` within the channel data `images`
+    auto copy = [&](unsigned char **images, size_t offset, const PixelSpan &dst, size_t n) {
+        for (size_t ch = 0; ch < 3; ++ch) {
+            if (chIdx[ch] < 0) continue;
+            int type = header.pixel_types[chIdx[ch]];
+            size_t size = type == TINYEXR_PIXELTYPE_HALF ? 2 : 4;
+            copyEXRChannel<false>(images[chIdx[ch]] + offset * size, type, dst, ch, n);
+        }
+    };
+
+    if (img.tiles) {
+        ThreadPool::get().parallelFor(size_t(img.num_tiles), [&](size_t t) {
+            const EXRTile &tile = img.tiles[t];
+            if (tile.level_x != 0 || tile.level_y != 0) return;
+            for (int y = 0; y < tile.height; ++y) {
+                PixelSpan dst = result->row(tile.offset_y * header.tile_size_y + y,
+                                            tile.offset_x * header.tile_size_x);
+                copy(tile.images, size_t(y * header.tile_size_x), dst, size_t(tile.width));
+            }
+        });
+    } else {
+        ThreadPool::get().parallelFor(size_t(height), [&](size_t i) {
+            copy(img.images, i * size_t(width), result->row(i), size_t(width));
+        });
+    }
+
+    return result;
+}
+
+/* Decode the region `r` of an EXR image from only the chunks that overlap it.
+   `offsets` point to all chunks of the image (including lower resolution
+   levels). Tiled images are read from the coarsest mip or rip level that the
+   downsampling factor allows, which tinyexr itself does not support. Blocks
+   at the border that do not cover whole pixels of that level are averaged
+   from level 0.
+   Both kinds are decoded in bands of a few hundred rows that are reduced
+   right away, so the region is never held in memory at full resolution.
+   Returns nullptr with a message in `err` if the file is damaged. */
+Image *decodeEXRRegion(EXRHeader &header, const std::vector<tinyexr::tinyexr_uint64> &offsets,
+                       const unsigned char *memory, size_t size, const Reduction &r,
+                       const int chIdx[3], PixelLayout layout, std::string *err) {
+    constexpr size_t BandHeight = 256;
+
+    int width  = header.data_window[2] - header.data_window[0] + 1,
+        height = header.data_window[3] - header.data_window[1] + 1;
+    if (width <= 0 || height <= 0) {
+        *err = "Invalid data window in EXR file.";
+        return nullptr;
+    }
+    std::unique_ptr<Image> result(new Image(r.outWidth, r.outHeight, layout));
+
+    if (!header.tiled) {
+        int lines = header.compression_type == TINYEXR_COMPRESSIONTYPE_ZIP ? 16 :
+                    header.compression_type == TINYEXR_COMPRESSIONTYPE_PIZ ? 32 :
+                    header.compression_type == TINYEXR_COMPRESSIONTYPE_ZFP ? 16 : 1;
+
+        // First row and offset of each chunk, sorted by row
+        std::vector<std::pair<int, tinyexr::tinyexr_uint64>> chunks;
+        for (tinyexr::tinyexr_uint64 offset : offsets) {
+            if (offset > size || size - offset < 8) {
+                *err = "Invalid offset in EXR chunk offset table.";
+                return nullptr;
+            }
+            unsigned int y;
+            memcpy(&y, memory + offset, 4);
+            tinyexr::swap4(&y);
+            chunks.emplace_back(int(y), offset);
+        }
+        std::sort(chunks.begin(), chunks.end());
+
+        // Decreasing line order is decoded as a whole, like tinyexr does it
+        size_t rowsPerBand = header.line_order == 0 ? std::max(BandHeight / r.factor, size_t(1)) : r.outHeight;
+        int dataWindow[2] = { header.data_window[1], header.data_window[3] };
+        for (size_t first = 0; first < r.outHeight; first += rowsPerBand) {
+            size_t last = std::min(first + rowsPerBand, r.outHeight), top, bottom, unused;
+            r.block(first, r.height, top, unused);
+            r.block(last - 1, r.height, unused, bottom);
+            int bandTop    = dataWindow[0] + int(r.y0 + top),
+                bandBottom = dataWindow[0] + int(r.y0 + bottom);
+
+            std::vector<tinyexr::tinyexr_uint64> bandOffsets;
+            for (auto &chunk : chunks) {
+                if (header.line_order != 0 || (chunk.first + lines > bandTop && chunk.first < bandBottom)) {
+                    if (bandOffsets.empty()) header.data_window[1] = std::max(chunk.first, dataWindow[0]);
+                    header.data_window[3] = std::min(chunk.first + lines - 1, dataWindow[1]);
+                    bandOffsets.push_back(chunk.second);
+                }
+            }
+            if (header.line_order != 0) {
+                header.data_window[1] = dataWindow[0];
+                header.data_window[3] = dataWindow[1];
+            }
+            int decodedTop = header.data_window[1];
+
+            EXRImage img;
+            InitEXRImage(&img);
+            std::unique_ptr<Image> band;
+            if (!bandOffsets.empty() &&
+                tinyexr::DecodeChunk(&img, &header, bandOffsets, memory, size, err) == TINYEXR_SUCCESS) {
+                for (int i = 0; i < header.num_channels; ++i) {
+                    header.pixel_types[i] = header.requested_pixel_types[i];
+                }
+                band.reset(convertEXR(header, img, chIdx, layout));
+            }
+            FreeEXRImage(&img);
+            header.data_window[1] = dataWindow[0];
+            header.data_window[3] = dataWindow[1];
+            if (!band || decodedTop > bandTop || decodedTop + int(band->getHeight()) < bandBottom) {
+                if (err->empty()) *err = "Missing scanlines in EXR file.";
+                return nullptr;
+            }
+
+            const Image &rows = *band;
+            size_t offset = size_t(decodedTop - dataWindow[0]);
+            reduceRowRange(r, *result, first, last, [&](size_t i, const PixelSpan &dst) {
+                ConstPixelSpan src = rows.row(i - offset, r.x0);
+                for (size_t j = 0; j < r.width; ++j) {
+                    dst.set(j, src.get(j));
+                }
+            });
+        }
+        return result.release();
+    }
 
-    int channels = img.num_channels;
-    int chIdx[4] = {0, 0, 0, 0};
-    for (int ch = 0; ch < channels; ++ch) {
-        if (strcmp(header.channels[ch].name, "R") == 0) chIdx[0] = ch;
-        if (strcmp(header.channels[ch].name, "G") == 0) chIdx[1] = ch;
-        if (strcmp(header.channels[ch].name, "B") == 0) chIdx[2] = ch;
-        if (strcmp(header.channels[ch].name, "A") == 0) chIdx[3] = ch;
+    std::vector<size_t> channelOffsets;
+    int pixelSize;
+    size_t channelOffset;
+    if (!tinyexr::ComputeChannelLayout(&channelOffsets, &pixelSize, &channelOffset,
+                                       header.num_channels, header.channels)) {
+        *err = "Failed to compute channel layout.";
+        return nullptr;
     }
-    channels = std::min(3, channels);    // At most read in 3 channels, without alpha
 
-    auto convert = [](void *p, int offset, int type) {
-        switch(type) {
-            case TINYEXR_PIXELTYPE_UINT: {
-                int32_t *pix = (int32_t *)p;
-                return (float)pix[offset];
+    /* Reduce the region `lr` of a level into rows [0, lr.outHeight) of `out`,
+       decoding only the tiles that overlap it, a band of rows at a time */
+    auto reduceLevel = [&](const Reduction &lr, int level, Image &out) {
+        int levelWidth  = levelSize(width,  level, header.tile_rounding_mode),
+            levelHeight = levelSize(height, level, header.tile_rounding_mode);
+
+        struct TileChunk {
+            const unsigned char *data;
+            size_t size;
+            int x, y;   // Tile coordinates
+        };
+        std::vector<TileChunk> tiles;
+        size_t tileWidth  = size_t(header.tile_size_x),
+               tileHeight = size_t(header.tile_size_y);
+        int tilesX = int((size_t(levelWidth)  + tileWidth  - 1) / tileWidth),
+            tilesY = int((size_t(levelHeight) + tileHeight - 1) / tileHeight);
+        for (tinyexr::tinyexr_uint64 offset : offsets) {
+            if (offset > size || size - offset < 20) {
+                *err = "Invalid offset in EXR chunk offset table.";
+                return false;
+            }
+
+            // Tile and level coordinates, followed by the size of the data
+            int coordinates[5];
+            memcpy(coordinates, memory + offset, 20);
+            for (int k = 0; k < 5; ++k) {
+                tinyexr::swap4((unsigned int *) &coordinates[k]);
+            }
+            if (coordinates[2] != level || coordinates[3] != level) {
+                continue;
+            }
+            if (coordinates[0] < 0 || coordinates[0] >= tilesX || coordinates[1] < 0 || coordinates[1] >= tilesY ||
+                coordinates[4] <= 0 || size_t(coordinates[4]) > size - offset - 20) {
+                *err = "Invalid tile in EXR file.";
+                return false;
+            }
+
+            size_t x = size_t(coordinates[0]) * tileWidth,
+                   y = size_t(coordinates[1]) * tileHeight;
+            if (x < lr.x0 + lr.width && x + tileWidth > lr.x0 && y < lr.y0 + lr.height && y + tileHeight > lr.y0) {
+                tiles.push_back({ memory + offset + 20, size_t(coordinates[4]), coordinates[0], coordinates[1] });
+            }
+        }
+
+        size_t rowsPerBand = std::max(std::max(BandHeight, 4 * tileHeight) / lr.factor, size_t(1));
+        for (size_t first = 0; first < lr.outHeight; first += rowsPerBand) {
+            size_t last = std::min(first + rowsPerBand, lr.outHeight), top, bottom, unused;
+            lr.block(first, lr.height, top, unused);
+            lr.block(last - 1, lr.height, unused, bottom);
+            top    += lr.y0;
+            bottom += lr.y0;
+
+            // Decode the tiles of the band in parallel and copy the part of each that lies in the region
+            std::vector<const TileChunk *> bandTiles;
+            for (const TileChunk &tile : tiles) {
+                size_t y = size_t(tile.y) * tileHeight;
+                if (y < bottom && y + tileHeight > top) {
+                    bandTiles.push_back(&tile);
+                }
             }
-            case TINYEXR_PIXELTYPE_HALF:
-            case TINYEXR_PIXELTYPE_FLOAT: {
-                float *pix = (float *)p;
-                return pix[offset];
+            Image band(lr.width, bottom - top, PixelLayout::Planar);
+            std::atomic<bool> failed(false);
+            ThreadPool::get().parallelFor(bandTiles.size(), [&](size_t t) {
+                const TileChunk &tile = *bandTiles[t];
+                unsigned char **images = tinyexr::AllocateImage(header.num_channels, header.channels,
+                                                                header.requested_pixel_types,
+                                                                header.tile_size_x, header.tile_size_y);
+                int w, h;
+                if (tinyexr::DecodeTiledPixelData(images, &w, &h, header.requested_pixel_types, tile.data, tile.size,
+                                                  header.compression_type, header.line_order, levelWidth, levelHeight,
+                                                  tile.x, tile.y, header.tile_size_x, header.tile_size_y, size_t(pixelSize),
+                                                  size_t(header.num_custom_attributes), header.custom_attributes,
+                                                  size_t(header.num_channels), header.channels, channelOffsets)) {
+                    size_t x = size_t(tile.x) * tileWidth,
+                           y = size_t(tile.y) * tileHeight,
+                           firstColumn = std::max(x, lr.x0),
+                           lastColumn  = std::min(x + size_t(w), lr.x0 + lr.width);
+                    for (size_t i = std::max(y, top); i < std::min(y + size_t(h), bottom); ++i) {
+                        PixelSpan dst = band.row(i - top, firstColumn - lr.x0);
+                        for (size_t ch = 0; ch < 3; ++ch) {
+                            if (chIdx[ch] < 0) continue;
+                            int type = header.requested_pixel_types[chIdx[ch]];
+                            size_t offset = ((i - y) * tileWidth + firstColumn - x) * (type == TINYEXR_PIXELTYPE_HALF ? 2 : 4);
+                            copyEXRChannel<false>(images[chIdx[ch]] + offset, type, dst, ch, lastColumn - firstColumn);
+                        }
+                    }
+                } else {
+                    failed = true;
+                }
+                for (int c = 0; c < header.num_channels; ++c) {
+                    free(images[c]);
+                }
+                free(images);
+            });
+            if (failed) {
+                *err = "Failed to decode tile data.";
+                return false;
             }
-            default:
-                return 0.f;
+
+            const Image &rows = band;
+            reduceRowRange(lr, out, first, last, [&](size_t i, const PixelSpan &dst) {
+                ConstPixelSpan src = rows.row(i - top);
+                for (size_t j = 0; j < lr.width; ++j) {
+                    dst.set(j, src.get(j));
+                }
+            });
         }
+        return true;
     };
 
-    int offset = 0;
-    for (int i = 0; i < img.height; ++i) {
-        for (int j = 0; j < img.width; ++j, ++offset) {
-            Color3f c;
-            if (channels == 3) {
-                for (int ch = 0; ch < channels; ++ch) {
-                    int ch_ = chIdx[ch];
-                    c[ch] = convert(img.images[ch_], offset, header.pixel_types[ch_]);
+    /* Coarsest level whose pixels still cover at most `factor` x `factor`
+       pixels, and whose grid is aligned with the corner of the region */
+    int rounding = header.tile_rounding_mode,
+        level = 0;
+    if (header.tile_level_mode == TINYEXR_TILE_MIPMAP_LEVELS ||
+        header.tile_level_mode == TINYEXR_TILE_RIPMAP_LEVELS) {
+        int levels = header.tile_level_mode == TINYEXR_TILE_MIPMAP_LEVELS ?
+                     levelCount(std::max(width, height), rounding) :
+                     std::min(levelCount(width, rounding), levelCount(height, rounding));
+        while (level + 1 < levels && r.factor % (size_t(2) << level) == 0 &&
+               r.x0 % (size_t(2) << level) == 0 && r.y0 % (size_t(2) << level) == 0) {
+            level++;
+        }
+    }
+    int levelWidth  = levelSize(width,  level, rounding),
+        levelHeight = levelSize(height, level, rounding);
+
+    // Region within that level, with the remaining downsampling factor
+    size_t scale = size_t(1) << level;
+    Reduction lr = r;
+    lr.x0 = std::min(r.x0 / scale, size_t(levelWidth  - 1));
+    lr.y0 = std::min(r.y0 / scale, size_t(levelHeight - 1));
+    lr.width  = std::min((r.x0 + r.width  + scale - 1) / scale, size_t(levelWidth))  - lr.x0;
+    lr.height = std::min((r.y0 + r.height + scale - 1) / scale, size_t(levelHeight)) - lr.y0;
+    lr.factor = r.factor / scale;
+    if (!reduceLevel(lr, level, *result)) {
+        return nullptr;
+    }
+    if (level == 0) {
+        return result.release();
+    }
+
+    /* A level pixel is the average of `scale` x `scale` pixels of level 0.
+       If the region does not end on that grid, the last column and row of
+       blocks only partially cover level pixels (or pixels that the level
+       rounded away), so they are reduced from level 0 instead. */
+    if ((r.x0 + r.width) % scale != 0) {
+        Reduction column = r;
+        column.x0 = r.x0 + (r.outWidth - 1) * r.factor;
+        column.width = r.x0 + r.width - column.x0;
+        column.outWidth = 1;
+        Image strip(1, r.outHeight, PixelLayout::Planar);
+        if (!reduceLevel(column, 0, strip)) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < r.outHeight; ++i) {
+            result->row(i).set(r.outWidth - 1, strip.row(i).get(0));
+        }
+    }
+    if ((r.y0 + r.height) % scale != 0) {
+        Reduction row = r;
+        row.y0 = r.y0 + (r.outHeight - 1) * r.factor;
+        row.height = r.y0 + r.height - row.y0;
+        row.outHeight = 1;
+        Image strip(r.outWidth, 1, PixelLayout::Planar);
+        if (!reduceLevel(row, 0, strip)) {
+            return nullptr;
+        }
+        PixelSpan dst = result->row(r.outHeight - 1);
+        for (size_t j = 0; j < r.outWidth; ++j) {
+            dst.set(j, strip.row(0).get(j));
+        }
+    }
+    return result.release();
+}
+
+/* Convert (the region `reduction` of) an uncompressed scanline EXR image
+   straight from the file contents in `memory` into an `Image`, without
+   letting tinyexr decode it into a full size buffer first. Returns nullptr if
+   the image is stored differently or if its offset table is damaged, tinyexr
+   handles these cases. */
+Image *decodeUncompressedEXR(const EXRHeader &header, const unsigned char *memory, size_t size,
+                             const Reduction &reduction, const int chIdx[3], PixelLayout layout) {
+    if (header.tiled || header.compression_type != TINYEXR_COMPRESSIONTYPE_NONE) {
+        return nullptr;
+    }
+
+    int width  = header.data_window[2] - header.data_window[0] + 1,
+        height = header.data_window[3] - header.data_window[1] + 1;
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+
+    // Each chunk holds one scanline with all channels one after another
+    std::vector<size_t> channelOffsets(size_t(header.num_channels));
+    size_t lineSize = 0;
+    for (int ch = 0; ch < header.num_channels; ++ch) {
+        const EXRChannelInfo &channel = header.channels[ch];
+        if (channel.x_sampling != 1 || channel.y_sampling != 1) {
+            return nullptr;
+        }
+        channelOffsets[ch] = lineSize;
+        lineSize += size_t(width) * (header.pixel_types[ch] == TINYEXR_PIXELTYPE_HALF ? 2 : 4);
+    }
+
+    // Validate the whole offset table before any pixel is written
+    const unsigned char *marker = memory + 8 + header.header_len;
+    if (size_t(header.header_len) + 8 + 8 * size_t(height) > size) {
+        return nullptr;
+    }
+    std::vector<const unsigned char *> lines(size_t(height), nullptr);
+    for (int c = 0; c < height; ++c, marker += 8) {
+        tinyexr::tinyexr_uint64 offset;
+        memcpy(&offset, marker, 8);
+        tinyexr::swap8(&offset);
+        if (offset < 8 || offset > size || size - offset < 8 + lineSize) {
+            return nullptr;
+        }
+
+        unsigned int y, dataSize;
+        memcpy(&y, memory + offset, 4);
+        memcpy(&dataSize, memory + offset + 4, 4);
+        tinyexr::swap4(&y);
+        tinyexr::swap4(&dataSize);
+        int i = int(y) - header.data_window[1];
+        if (i < 0 || i >= height || lines[i] || dataSize != lineSize) {
+            return nullptr;
+        }
+        lines[i] = memory + offset + 8;
+    }
+
+    return reduceRows(reduction, layout, [&](size_t i, const PixelSpan &dst) {
+        for (size_t ch = 0; ch < 3; ++ch) {
+            if (chIdx[ch] < 0) continue;
+            int type = header.pixel_types[chIdx[ch]];
+            size_t offset = channelOffsets[chIdx[ch]] + reduction.x0 * (type == TINYEXR_PIXELTYPE_HALF ? 2 : 4);
+            copyEXRChannel<true>(lines[i] + offset, type, dst, ch, reduction.width);
+        }
+    });
+}
+
+// Scale factors for the shared exponent of RGBE pixels, matching stb_image
+struct RGBEScales {
+    RGBEScales() {
+        scale[0] = 0.f;
+        for (int e = 1; e < 256; ++e) {
+            scale[e] = float(std::ldexp(1.f, e - (128 + 8)));
+        }
+    }
+
+    float scale[256];
+};
+
+// Convert `n` RGBE pixels into floating point RGB
+void convertRGBE(const uint8_t *rgbe, const PixelSpan &dst, size_t n) {
+    static const RGBEScales scales;
+    for (size_t j = 0; j < n; ++j, rgbe += 4) {
+        float scale = scales.scale[rgbe[3]];
+        dst.set(j, Color3f(rgbe[0] * scale, rgbe[1] * scale, rgbe[2] * scale));
+    }
+}
+
+// Next line of a Radiance file header, without the newline character
+bool readLine(const uint8_t *&pos, const uint8_t *end, std::string &line) {
+    const uint8_t *newline = (const uint8_t *) memchr(pos, '\n', size_t(end - pos));
+    if (!newline) {
+        return false;
+    }
+    line.assign((const char *) pos, size_t(newline - pos));
+    pos = newline + 1;
+    return true;
+}
+
+/* Decode a Radiance RGBE file straight from the file contents into an
+   `Image`. Flat files are converted in parallel, run-length encoded files
+   one scanline at a time via a buffer of a single scanline. Returns nullptr
+   for variants that are not handled here (other formats or orientations),
+   stb_image reports these.
+   Of a region of interest, only the scanlines up to its last one are
+   decoded, and only its RGBE pixels are kept until they are downsampled. */
+Image *decodeRGBE(const uint8_t *data, size_t size, const std::string &filename, const LoadOptions &options) {
+    const uint8_t *pos = data,
+                  *end = data + size;
+
+    std::string line;
+    if (!readLine(pos, end, line) || (line != "#?RADIANCE" && line != "#?RGBE")) {
+        return nullptr;
+    }
+    bool valid = false;
+    while (readLine(pos, end, line) && !line.empty()) {
+        if (line == "FORMAT=32-bit_rle_rgbe") valid = true;
+    }
+    int width, height;
+    if (!valid || !readLine(pos, end, line) ||
+        sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 ||
+        width <= 0 || height <= 0 || width > (1 << 24) || height > (1 << 24)) {
+        return nullptr;
+    }
+
+    size_t w = size_t(width),
+           h = size_t(height),
+           available = size_t(end - pos);
+    Reduction reduction(options, w, h);
+    checkRegion(reduction, filename);
+
+    // Only scanlines of suitable width start with the marker of the RLE scheme
+    bool rle = w >= 8 && w < 32768 && available >= 4 &&
+               pos[0] == 2 && pos[1] == 2 && !(pos[2] & 0x80);
+    if (!rle) {
+        if (available / 4 / w < h) {
+            ERROR("Bitmap(): HDR file \"%s\" is truncated.", filename);
+        }
+        return reduceRows(reduction, options.layout, [&](size_t i, const PixelSpan &dst) {
+            convertRGBE(pos + 4 * (w * i + reduction.x0), dst, reduction.width);
+        });
+    }
+
+    std::unique_ptr<Image> result;
+    std::vector<uint8_t> region;
+    if (reduction.identity) {
+        result.reset(new Image(w, h, options.layout));
+    } else {
+        region.resize(4 * reduction.width * reduction.height);
+    }
+
+    // Each scanline stores its four components separately as runs and dumps
+    std::vector<uint8_t> scanline(4 * w);
+    for (size_t i = 0; i < reduction.y0 + reduction.height; ++i) {
+        if (end - pos < 4 || pos[0] != 2 || pos[1] != 2 || size_t((pos[2] << 8) | pos[3]) != w) {
+            ERROR("Bitmap(): Invalid scanline in HDR file \"%s\".", filename);
+        }
+        pos += 4;
+
+        for (size_t k = 0; k < 4; ++k) {
+            for (size_t j = 0; j < w;) {
+                if (pos == end) {
+                    ERROR("Bitmap(): HDR file \"%s\" is truncated.", filename);
                 }
-            } else {
-                int ch_ = chIdx[0];
-                c = convert(img.images[ch_], offset, header.pixel_types[ch_]);
+                size_t count = *pos++;
+                if (count > 128) {
+                    count -= 128;
+                    if (count > w - j || pos == end) {
+                        ERROR("Bitmap(): Bad RLE data in HDR file \"%s\".", filename);
+                    }
+                    uint8_t value = *pos++;
+                    for (; count > 0; --count, ++j) scanline[4 * j + k] = value;
+                } else {
+                    if (count == 0 || count > w - j || count > size_t(end - pos)) {
+                        ERROR("Bitmap(): Bad RLE data in HDR file \"%s\".", filename);
+                    }
+                    for (; count > 0; --count, ++j) scanline[4 * j + k] = *pos++;
+                }
+            }
+        }
+
+        if (result) {
+            convertRGBE(scanline.data(), result->row(i), w);
+        } else if (i >= reduction.y0) {
+            memcpy(&region[4 * reduction.width * (i - reduction.y0)], &scanline[4 * reduction.x0],
+                   4 * reduction.width);
+        }
+    }
+
+    if (result) {
+        return result.release();
+    }
+    return reduceRows(reduction, options.layout, [&](size_t i, const PixelSpan &dst) {
+        convertRGBE(&region[4 * reduction.width * (i - reduction.y0)], dst, reduction.width);
+    });
+}
+
+/* Decode the region `r` of the data window of part `part` of the EXR file in
+   `data`, which has `count` parts if it is `multipart`. Returns nullptr with
+   a message in `err` if the file is damaged. */
+Image *decodeEXRImage(EXRHeader **headers, int count, int part, bool multipart,
+                      const unsigned char *data, size_t size, const Reduction &r,
+                      const int chIdx[3], PixelLayout layout, std::string *err) {
+    EXRHeader &header = *headers[part];
+    if (!multipart) {
+        if (Image *result = decodeUncompressedEXR(header, data, size, r, chIdx, layout)) {
+            return result;
+        }
+    }
+
+    requestPixelTypes(header, layout);
+
+    if (!r.identity) {
+        // Only the chunks that overlap the region, but of all levels
+        std::vector<tinyexr::tinyexr_uint64> offsets;
+        if (multipart) {
+            if (readPartOffsets(headers, count, part, size_t(header.chunk_count), data, size, offsets, err) != 0) {
+                return nullptr;
             }
-            result->ref(i, j) = c;
+        } else if (!readChunkOffsets(header, data, size, offsets)) {
+            *err = "Invalid EXR chunk offset table.";
+            return nullptr;
         }
+        return decodeEXRRegion(header, offsets, data, size, r, chIdx, layout, err);
     }
 
+    EXRImage img;
+    InitEXRImage(&img);
+    int ret;
+    if (multipart) {
+        ret = decodeEXRPart(&img, headers, count, part, data, size, err);
+    } else {
+        const char *message = nullptr;
+        ret = LoadEXRImageFromMemory(&img, &header, data, size, &message);
+        if (message) {
+            *err = message;
+            FreeEXRErrorMessage(message);
+        }
+    }
+
+    Image *result = nullptr;
+    if (ret == TINYEXR_SUCCESS) {
+        for (int i = 0; i < header.num_channels; ++i) {
+            header.pixel_types[i] = header.requested_pixel_types[i];
+        }
+        result = convertEXR(header, img, chIdx, layout);
+    }
     FreeEXRImage(&img);
-    FreeEXRHeader(&header);
+    return result;
+}
 
+} // Anonymous namespace
+
+Image *decodeEXR(const unsigned char *data, size_t size, const std::string &filename, const LoadOptions &options) {
+    const char *err = nullptr;
+
+    EXRVersion version;
+    if (ParseEXRVersionFromMemory(&version, data, size) != 0) {
+        ERROR("Bitmap(): Could not parse EXR file \"%s\".", filename);
+    }
+
+    // Single-part files are handled like a multi-part file with one part
+    EXRHeader **headers = nullptr;
+    int count = 0;
+    if (version.multipart) {
+        if (ParseEXRMultipartHeaderFromMemory(&headers, &count, &version, data, size, &err) != 0) {
+            ERROR("Bitmap(): Could not parse EXR file \"%s\". %s", filename, err);
+        }
+    } else {
+        headers = (EXRHeader **) malloc(sizeof(EXRHeader *));
+        headers[0] = (EXRHeader *) malloc(sizeof(EXRHeader));
+        InitEXRHeader(headers[0]);
+        count = 1;
+        if (ParseEXRHeaderFromMemory(headers[0], &version, data, size, &err) != 0) {
+            free(headers[0]);
+            free(headers);
+            ERROR("Bitmap(): Could not parse EXR file \"%s\". %s", filename, err);
+        }
+    }
+    auto freeHeaders = [&]() {
+        for (int i = 0; i < count; ++i) {
+            FreeEXRHeader(headers[i]);
+            free(headers[i]);
+        }
+        free(headers);
+    };
+
+    int part = version.multipart ? findPart(headers, count, options.part) :
+               options.part.empty() || options.part == "0" || options.part == partName(*headers[0]) ? 0 : -1;
+    if (part < 0) {
+        freeHeaders();
+        ERROR("Bitmap(): EXR file \"%s\" has no part \"%s\".", filename, options.part);
+    }
+
+    EXRHeader &header = *headers[part];
+    if (version.multipart) {
+        readTileDescription(header);
+    }
+
+    int chIdx[3];
+    std::string decodeErr;
+    if (!selectChannels(header, options.channels, chIdx, &decodeErr)) {
+        freeHeaders();
+        ERROR("Bitmap(): %s (EXR file \"%s\")", decodeErr, filename);
+    }
+
+    const int *dataWindow = header.data_window,
+              *displayWindow = header.display_window;
+    bool useDisplayWindow = options.displayWindow &&
+                            !std::equal(dataWindow, dataWindow + 4, displayWindow);
+    const int *window = useDisplayWindow ? displayWindow : dataWindow;
+    Reduction reduction(options, size_t(window[2] - window[0] + 1), size_t(window[3] - window[1] + 1));
+    if (!reduction.valid) {
+        freeHeaders();
+        checkRegion(reduction, filename);
+    }
+
+    Image *result = nullptr;
+    if (!useDisplayWindow) {
+        result = decodeEXRImage(headers, count, part, version.multipart != 0, data, size,
+                                reduction, chIdx, options.layout, &decodeErr);
+    } else {
+        /* Only the part of the data window within the region is decoded (at
+           full resolution), everything else in the display window is black */
+        int x0 = std::max(window[0] + int(reduction.x0), dataWindow[0]),
+            y0 = std::max(window[1] + int(reduction.y0), dataWindow[1]),
+            x1 = std::min(window[0] + int(reduction.x0 + reduction.width)  - 1, dataWindow[2]),
+            y1 = std::min(window[1] + int(reduction.y0 + reduction.height) - 1, dataWindow[3]);
+        std::unique_ptr<Image> overlap;
+        bool failed = false;
+        if (x0 <= x1 && y0 <= y1) {
+            LoadOptions overlapOptions;
+            overlapOptions.roiX = size_t(x0 - dataWindow[0]);
+            overlapOptions.roiY = size_t(y0 - dataWindow[1]);
+            overlapOptions.roiWidth  = size_t(x1 - x0 + 1);
+            overlapOptions.roiHeight = size_t(y1 - y0 + 1);
+            Reduction overlapReduction(overlapOptions, size_t(dataWindow[2] - dataWindow[0] + 1),
+                                       size_t(dataWindow[3] - dataWindow[1] + 1));
+            overlap.reset(decodeEXRImage(headers, count, part, version.multipart != 0, data, size,
+                                         overlapReduction, chIdx, PixelLayout::Planar, &decodeErr));
+            failed = !overlap;
+        }
+
+        if (!failed) {
+            // Position of the overlap within the region
+            size_t left = size_t(x0 - window[0]) - reduction.x0,
+                   top  = size_t(y0 - window[1]) - reduction.y0;
+            const Image *pixels = overlap.get();
+            result = reduceRows(reduction, options.layout, [&](size_t i, const PixelSpan &dst) {
+                for (size_t j = 0; j < reduction.width; ++j) {
+                    dst.set(j, Color3f(0.f));
+                }
+                if (pixels && i - reduction.y0 >= top && i - reduction.y0 < top + pixels->getHeight()) {
+                    ConstPixelSpan src = pixels->row(i - reduction.y0 - top);
+                    for (size_t j = 0; j < pixels->getWidth(); ++j) {
+                        dst.set(left + j, src.get(j));
+                    }
+                }
+            });
+        }
+    }
+    freeHeaders();
+
+    if (!result) {
+        ERROR("Bitmap(): Could not open EXR file \"%s\". %s", filename, decodeErr);
+    }
     return result;
 }
 
-Image *loadFromHDR(const std::string &filename) {
+Image *loadFromEXR(const std::string &filename, const LoadOptions &options) {
+    MappedFile file(filename);
+    if (!file.isValid()) {
+        ERROR("Bitmap(): Could not open EXR file \"%s\".", filename);
+    }
+    return decodeEXR(file.getData(), file.getSize(), filename, options);
+}
+
+Image *decodeHDR(const uint8_t *data, size_t size, const std::string &filename, const LoadOptions &options) {
+    if (Image *result = decodeRGBE(data, size, filename, options)) {
+        return result;
+    }
+
+    // Gray images are expanded to RGB by stb_image
     int width, height, channels;
-    float *data = stbi_loadf(filename.c_str(), &width, &height, &channels, 0);
+    float *pixels = stbi_loadf_from_memory(data, int(std::min(size, size_t(std::numeric_limits<int>::max()))),
+                                           &width, &height, &channels, 3);
+    if (!pixels) {
+        ERROR("Bitmap(): Could not open HDR file \"%s\". %s", filename, stbi_failure_reason());
+    }
 
-    Image *result = new Image(width, height);
+    Image *result = new Image(width, height, (Color3f *) pixels, [pixels]() { stbi_image_free(pixels); });
+    Reduction reduction(options, size_t(width), size_t(height));
+    if (!reduction.identity) {
+        std::unique_ptr<Image> image(result);
+        checkRegion(reduction, filename);
+        return reduceImage(*image, reduction, options.layout);
+    }
+    result->setLayout(options.layout);
+    return result;
+}
 
-    // At most read in 3 channels, without alpha
-    channels = std::min(3, channels);
+Image *loadFromHDR(const std::string &filename, const LoadOptions &options) {
+    MappedFile file(filename);
+    if (!file.isValid()) {
+        ERROR("Bitmap(): Could not open HDR file \"%s\".", filename);
+    }
+    return decodeHDR(file.getData(), file.getSize(), filename, options);
+}
 
-    float *src = data;
-    for (int i = 0; i < height; ++i) {
-        for (int j = 0; j < width; ++j) {
-            Color3f c;
+namespace {
+
+inline bool isLittleEndianHost() {
+    uint16_t one = 1;
+    uint8_t first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+inline float readFloat(const uint8_t *p, bool swap) {
+    uint8_t bytes[4] = { p[0], p[1], p[2], p[3] };
+    if (swap) {
+        std::swap(bytes[0], bytes[3]);
+        std::swap(bytes[1], bytes[2]);
+    }
+    float value;
+    memcpy(&value, bytes, 4);
+    return value;
+}
+
+/* Header of a ".pfm" file: "PF" (RGB) or "Pf" (gray), the resolution, and a
+   scale whose sign gives the byte order of the data (negative for
+   little-endian). `pos` is moved to the start of the data. */
+bool parsePFMHeader(const uint8_t *&pos, const uint8_t *end, size_t &width, size_t &height,
+                    size_t &channels, float &scale) {
+    auto token = [&]() {
+        std::string result;
+        while (pos < end && isspace(*pos)) pos++;
+        while (pos < end && !isspace(*pos) && result.size() < 32) result += char(*pos++);
+        return result;
+    };
+    std::string magic = token(),
+                w = token(),
+                h = token(),
+                s = token();
+    if ((magic != "PF" && magic != "Pf") || pos == end) {
+        return false;
+    }
+    pos++;  // Single whitespace character before the data
+
+    channels = magic == "PF" ? 3 : 1;
+    width  = size_t(strtoul(w.c_str(), nullptr, 10));
+    height = size_t(strtoul(h.c_str(), nullptr, 10));
+    scale  = strtof(s.c_str(), nullptr);
+    return width > 0 && height > 0 && width <= (1 << 24) && height <= (1 << 24) && scale != 0.f;
+}
+
+// The magnitude of the scale is ignored, like most other tools do
+Image *decodePFM(const uint8_t *data, size_t size, const std::string &filename, const LoadOptions &options) {
+    const uint8_t *pos = data,
+                  *end = data + size;
+    size_t width, height, channels;
+    float scale;
+    if (!parsePFMHeader(pos, end, width, height, channels, scale)) {
+        ERROR("Bitmap(): Could not parse PFM file \"%s\".", filename);
+    }
+    size_t rowSize = 4 * channels * width;
+    if (size_t(end - pos) / rowSize < height) {
+        ERROR("Bitmap(): PFM file \"%s\" is truncated.", filename);
+    }
+    bool swap = (scale < 0.f) != isLittleEndianHost();
+    Reduction reduction(options, width, height);
+    checkRegion(reduction, filename);
+
+    // Rows are stored from bottom to top
+    return reduceRows(reduction, options.layout, [&](size_t i, const PixelSpan &dst) {
+        const uint8_t *src = pos + (height - 1 - i) * rowSize + 4 * channels * reduction.x0;
+        if (dst.stride == 3 && !dst.isHalf() && channels == 3 && !swap) {
+            memcpy(dst.channels[0], src, 12 * reduction.width);
+            return;
+        }
+        for (size_t j = 0; j < reduction.width; ++j) {
+            const uint8_t *p = src + 4 * channels * j;
             if (channels == 3) {
-                for (int ch = 0; ch < 3; ++ch) {
-                    c[ch] = src[0];
-                    src++;
-                }
+                dst.set(j, Color3f(readFloat(p, swap), readFloat(p + 4, swap), readFloat(p + 8, swap)));
             } else {
-                c = src[0];
-                src++;
+                dst.set(j, Color3f(readFloat(p, swap)));
+            }
+        }
+    });
+}
+
+/* Headerless RGB floats with the resolution from `options`. Full precision
+   data is adopted by the image, which keeps `owner` alive as long as it uses
+   the memory. Half floats and regions of interest are converted in
+   parallel. */
+Image *decodeRaw(uint8_t *data, size_t size, const std::string &filename, const LoadOptions &options,
+                 std::shared_ptr<void> owner) {
+    size_t width  = options.rawWidth,
+           height = options.rawHeight,
+           sampleSize = options.rawHalf ? 2 : 4;
+    if (width == 0 || height == 0) {
+        ERROR("Bitmap(): The resolution of the raw file \"%s\" is not known.", filename);
+    }
+    if (size / (3 * sampleSize * width) != height || size % (3 * sampleSize * width) != 0) {
+        ERROR("Bitmap(): Raw file \"%s\" has %d bytes, expected %d for %d x %d pixels.",
+              filename, size, 3 * sampleSize * width * height, width, height);
+    }
+
+    Reduction reduction(options, width, height);
+    checkRegion(reduction, filename);
+    if (reduction.identity && !options.rawHalf && uintptr_t(data) % alignof(Color3f) == 0) {
+        Image *result = new Image(width, height, (Color3f *) data, [owner]() {});
+        result->setLayout(options.layout);
+        return result;
+    }
+
+    return reduceRows(reduction, options.layout, [&](size_t i, const PixelSpan &dst) {
+        const uint8_t *src = data + 3 * sampleSize * (width * i + reduction.x0);
+        for (size_t j = 0; j < reduction.width; ++j) {
+            Color3f c;
+            for (size_t ch = 0; ch < 3; ++ch) {
+                if (options.rawHalf) {
+                    uint16_t bits;
+                    memcpy(&bits, src + 2 * (3 * j + ch), 2);
+                    c[ch] = halfToFloat(bits);
+                } else {
+                    memcpy(&c[ch], src + 4 * (3 * j + ch), 4);
+                }
             }
-            result->ref(i, j) = c;
+            dst.set(j, c);
         }
+    });
+}
+
+// Read all of standard input in one go
+std::vector<uint8_t> readStandardInput() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    std::vector<uint8_t> buffer;
+    size_t size = 0;
+    while (true) {
+        buffer.resize(std::max(size_t(1) << 20, 2 * size));
+        size += fread(buffer.data() + size, 1, buffer.size() - size, stdin);
+        if (size < buffer.size()) break;
+    }
+    if (ferror(stdin)) {
+        ERROR("Bitmap(): Could not read from standard input.");
+    }
+    buffer.resize(size);
+    return buffer;
+}
+
+} // Anonymous namespace
+
+Image *loadFromPFM(const std::string &filename, const LoadOptions &options) {
+    MappedFile file(filename);
+    if (!file.isValid()) {
+        ERROR("Bitmap(): Could not open PFM file \"%s\".", filename);
     }
+    return decodePFM(file.getData(), file.getSize(), filename, options);
+}
 
-    stbi_image_free(data);
-    return result;
+Image *loadFromRaw(const std::string &filename, const LoadOptions &options) {
+    // Copy-on-write, so that the image can adopt the mapping
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(filename, !options.rawHalf);
+    if (!file->isValid()) {
+        ERROR("Bitmap(): Could not open raw file \"%s\".", filename);
+    }
+    uint8_t *data = options.rawHalf ? (uint8_t *) file->getData() : file->getMutableData();
+    return decodeRaw(data, file->getSize(), filename, options, file);
 }
 
-Image *Image::load(const std::string &filename) {
+// The format is detected from the data, raw data needs `LoadOptions::rawWidth`
+Image *loadFromStandardInput(const LoadOptions &options) {
+    std::shared_ptr<std::vector<uint8_t>> buffer = std::make_shared<std::vector<uint8_t>>(readStandardInput());
+    const uint8_t *data = buffer->data();
+    size_t size = buffer->size();
+    const std::string name = "<stdin>";
+
+    auto startsWith = [&](const char *magic) {
+        return size >= strlen(magic) && memcmp(data, magic, strlen(magic)) == 0;
+    };
+    if (options.rawWidth > 0) {
+        return decodeRaw(buffer->data(), size, name, options, buffer);
+    } else if (startsWith("\x76\x2f\x31\x01")) {
+        return decodeEXR(data, size, name, options);
+    } else if (startsWith("#?")) {
+        return decodeHDR(data, size, name, options);
+    } else if (startsWith("PF") || startsWith("Pf")) {
+        return decodePFM(data, size, name, options);
+    }
+    ERROR("Bitmap(): Could not detect the format of the data on standard input.");
+}
+
+Image *Image::load(const std::string &filename, const LoadOptions &options) {
     Image *image = nullptr;
 
     std::string extension = std::filesystem::path(filename).extension().string();
-    if (extension == ".exr") {
-        image = loadFromEXR(filename);
+    if (filename == "-") {
+        image = loadFromStandardInput(options);
+    } else if (extension == ".exr") {
+        image = loadFromEXR(filename, options);
     } else if (extension == ".hdr") {
-        image = loadFromHDR(filename);
+        image = loadFromHDR(filename, options);
+    } else if (extension == ".pfm") {
+        image = loadFromPFM(filename, options);
+    } else if (extension == ".raw") {
+        image = loadFromRaw(filename, options);
     } else if (extension == "") {
         PRINT("");
         WARN("Image::load(): Did not recognize file extension for \"%s\".", filename);
     } else {
         PRINT("");
-        WARN("Image::load(): Invalid file extension in \"%s\". Only \".exr\" or \".hdr\" formats are supported.", filename);
+        WARN("Image::load(): Invalid file extension in \"%s\". Only \".exr\", \".hdr\", \".pfm\" or \".raw\" formats are supported.", filename);
     }
 
     if (image) {
         image->setFilename(filename);
-        image->precompute();
         return image;
     }
 
     return nullptr;
 }
 
-void Image::save(const std::string &filename) const {
+bool Image::readSize(const std::string &filename, size_t &width, size_t &height) {
+    std::string extension = std::filesystem::path(filename).extension().string();
+    if (extension == ".exr") {
+        EXRVersion version;
+        const char *err = nullptr;
+        if (ParseEXRVersionFromFile(&version, filename.c_str()) != 0) {
+            return false;
+        }
+
+        EXRHeader **headers = nullptr;
+        int count = 0;
+        if (version.multipart) {
+            if (ParseEXRMultipartHeaderFromFile(&headers, &count, &version, filename.c_str(), &err) != 0) {
+                if (err) FreeEXRErrorMessage(err);
+                return false;
+            }
+        } else {
+            headers = (EXRHeader **) malloc(sizeof(EXRHeader *));
+            headers[0] = (EXRHeader *) malloc(sizeof(EXRHeader));
+            count = 1;
+            InitEXRHeader(headers[0]);
+            if (ParseEXRHeaderFromFile(headers[0], &version, filename.c_str(), &err) != 0) {
+                if (err) FreeEXRErrorMessage(err);
+                free(headers[0]);
+                free(headers);
+                return false;
+            }
+        }
+
+        // Largest part, the one that is going to be loaded is not known here
+        width = height = 0;
+        for (int i = 0; i < count; ++i) {
+            const EXRHeader &header = *headers[i];
+            size_t w = size_t(header.data_window[2] - header.data_window[0] + 1),
+                   h = size_t(header.data_window[3] - header.data_window[1] + 1);
+            if (w * h > width * height) {
+                width  = w;
+                height = h;
+            }
+            FreeEXRHeader(headers[i]);
+            free(headers[i]);
+        }
+        free(headers);
+        return true;
+    } else if (extension == ".hdr") {
+        int w, h, channels;
+        if (!stbi_info(filename.c_str(), &w, &h, &channels)) {
+            return false;
+        }
+        width  = size_t(w);
+        height = size_t(h);
+        return true;
+    } else if (extension == ".pfm") {
+        MappedFile file(filename);
+        const uint8_t *pos = file.getData();
+        size_t channels;
+        float scale;
+        return file.isValid() && parsePFMHeader(pos, pos + file.getSize(), width, height, channels, scale);
+    }
+    return false;
+}
+
+uint32_t zlibCRC32(uint32_t crc, const uint8_t *data, size_t size) {
+    return uint32_t(tinyexr::miniz::mz_crc32(crc, data, size));
+}
+
+uint32_t zlibAdler32(uint32_t adler, const uint8_t *data, size_t size) {
+    return uint32_t(tinyexr::miniz::mz_adler32(adler, data, size));
+}
+
+bool zlibDeflate(const uint8_t *data, size_t size, int level, bool last, std::vector<uint8_t> &out) {
+    namespace mz = tinyexr::miniz;
+    mz::mz_uint flags = mz::tdefl_create_comp_flags_from_zip_params(level, -15,
+        level == 1 ? mz::MZ_RLE : mz::MZ_DEFAULT_STRATEGY);
+    auto put = [](const void *data, int size, void *user) -> mz::mz_bool {
+        std::vector<uint8_t> *out = (std::vector<uint8_t> *) user;
+        out->insert(out->end(), (const uint8_t *) data, (const uint8_t *) data + size);
+        return 1;
+    };
+    std::unique_ptr<mz::tdefl_compressor> compressor(new mz::tdefl_compressor);
+    mz::tdefl_init(compressor.get(), put, &out, int(flags));
+    mz::tdefl_status status = mz::tdefl_compress_buffer(compressor.get(), data, size,
+        last ? mz::TDEFL_FINISH : mz::TDEFL_FULL_FLUSH);
+    return status == (last ? mz::TDEFL_STATUS_DONE : mz::TDEFL_STATUS_OKAY);
+}
+
+std::vector<uint8_t> compressEXRZip(const std::vector<uint8_t> &raw) {
+    std::vector<uint8_t> compressed(size_t(tinyexr::miniz::mz_compressBound(raw.size())));
+    tinyexr::tinyexr_uint64 compressedSize;
+    tinyexr::CompressZip(compressed.data(), compressedSize, raw.data(), (unsigned long) raw.size());
+    compressed.resize(size_t(compressedSize));
+    return compressed;
+}
+
+namespace {
+
+// Extension that selects the format of `filename`, see `SaveOptions::format`
+std::string saveFormat(const std::string &filename, const SaveOptions &options) {
+    if (!options.format.empty()) {
+        return options.format;
+    }
+    return std::filesystem::path(filename).extension().string();
+}
+
+} // Anonymous namespace
+
+void Image::save(const std::string &filename, const SaveOptions &options) const {
+    int bitDepth = getBitDepth(filename, options);
+    if (bitDepth == 0) {
+        std::string format = saveFormat(filename, options);
+        bool success;
+        if (format == ".exr") {
+            success = encodeEXR(filename, *this, options.exrHalf);
+        } else if (format == ".pfm") {
+            success = encodePFM(filename, *this);
+        } else {
+            success = encodeRaw(filename, *this, options.rawHalf);
+        }
+        if (!success) {
+            PRINT("");
+            WARN("save(): Could not save file \"%s\"", filename);
+        }
+    } else if (bitDepth == 16) {
+        std::unique_ptr<uint16_t[]> rgb16(new uint16_t[3 * m_width * m_height]);
+        ThreadPool::get().parallelFor(m_height, [&](size_t i) {
+            quantize(row(i), m_width, rgb16.get() + 3 * m_width * i, options.dither, i);
+        });
+        saveLDR(filename, rgb16.get(), m_width, m_height, options);
+    } else {
+        std::unique_ptr<uint8_t[]> rgb8(new uint8_t[3 * m_width * m_height]);
+        ThreadPool::get().parallelFor(m_height, [&](size_t i) {
+            quantize(row(i), m_width, rgb8.get() + 3 * m_width * i, options.dither, i);
+        });
+        saveLDR(filename, rgb8.get(), m_width, m_height, options);
+    }
+}
+
+int Image::getBitDepth(const std::string &filename, const SaveOptions &options) {
+    std::string extension = saveFormat(filename, options);
+    if (extension == ".exr" || extension == ".pfm" || extension == ".raw") {
+        return 0;
+    } else if (extension == ".tif" || extension == ".tiff" || extension == ".ppm") {
+        return 16;
+    } else if (extension == ".png" && options.bitDepth == 16) {
+        return 16;
+    }
+    return 8;
+}
+
+namespace {
+
+// Edge length of the tiles of dither thresholds
+constexpr size_t DitherTileSize = 64;
+
+std::vector<float> bayerTile() {
+    std::vector<float> tile(DitherTileSize * DitherTileSize);
+    for (size_t y = 0; y < DitherTileSize; ++y) {
+        for (size_t x = 0; x < DitherTileSize; ++x) {
+            // Index into the 8 x 8 Bayer matrix, built from the interleaved bits of x ^ y and y
+            size_t index = 0;
+            for (size_t bit = 0; bit < 3; ++bit) {
+                index = (index << 2) | ((((x ^ y) >> bit) & 1) << 1) | ((y >> bit) & 1);
+            }
+            tile[y * DitherTileSize + x] = (float(index) + 0.5f) / 64.f;
+        }
+    }
+    return tile;
+}
+
+/* Blue noise thresholds from the void-and-cluster method, see "The
+   void-and-cluster method for dither array generation" by Ulichney 1993.
+   Points are ranked by the order in which they are removed from (or added to)
+   a pattern, always picking the tightest cluster (or largest void) under a
+   Gaussian energy filter on the torus. */
+std::vector<float> blueNoiseTile() {
+    const int N = int(DitherTileSize),
+              Size = N * N;
+    const float sigma = 1.5f;
+
+    std::vector<float> filter(Size);
+    for (int dy = 0; dy < N; ++dy) {
+        for (int dx = 0; dx < N; ++dx) {
+            float x = float(std::min(dx, N - dx)),
+                  y = float(std::min(dy, N - dy));
+            filter[dy * N + dx] = std::exp(-(x * x + y * y) / (2.f * sigma * sigma));
+        }
+    }
+
+    std::vector<uint8_t> pattern(Size, 0);
+    std::vector<float> energy(Size, 0.f);
+    auto toggle = [&](int p) {
+        float sign = pattern[p] ? -1.f : 1.f;
+        pattern[p] = !pattern[p];
+        int px = p % N,
+            py = p / N;
+        for (int y = 0; y < N; ++y) {
+            const float *row = filter.data() + ((y - py + N) % N) * N;
+            for (int x = 0; x < N; ++x) {
+                energy[y * N + x] += sign * row[(x - px + N) % N];
+            }
+        }
+    };
+    auto tightestCluster = [&]() {
+        int best = -1;
+        for (int p = 0; p < Size; ++p) {
+            if (pattern[p] && (best < 0 || energy[p] > energy[best])) best = p;
+        }
+        return best;
+    };
+    auto largestVoid = [&]() {
+        int best = -1;
+        for (int p = 0; p < Size; ++p) {
+            if (!pattern[p] && (best < 0 || energy[p] < energy[best])) best = p;
+        }
+        return best;
+    };
+
+    // Fixed seed, so the tile (and every dithered file) is reproducible
+    uint32_t state = 12345;
+    auto random = [&]() {
+        state = state * 1664525u + 1013904223u;
+        return int((state >> 8) % uint32_t(Size));
+    };
+
+    // Initial pattern with 10% of the points, moved from clusters into voids until it is stable
+    int initialPoints = Size / 10;
+    for (int count = 0; count < initialPoints;) {
+        int p = random();
+        if (!pattern[p]) {
+            toggle(p);
+            count++;
+        }
+    }
+    while (true) {
+        int cluster = tightestCluster();
+        toggle(cluster);
+        int largest = largestVoid();
+        toggle(largest);
+        if (largest == cluster) break;
+    }
+
+    std::vector<int> rank(Size);
+    std::vector<uint8_t> initialPattern = pattern;
+    std::vector<float> initialEnergy = energy;
+    for (int r = initialPoints - 1; r >= 0; --r) {
+        int cluster = tightestCluster();
+        rank[cluster] = r;
+        toggle(cluster);
+    }
+    pattern = initialPattern;
+    energy = initialEnergy;
+    for (int r = initialPoints; r < Size; ++r) {
+        int largest = largestVoid();
+        rank[largest] = r;
+        toggle(largest);
+    }
+
+    std::vector<float> tile(Size);
+    for (int p = 0; p < Size; ++p) {
+        tile[p] = (float(rank[p]) + 0.5f) / float(Size);
+    }
+    return tile;
+}
+
+// Thresholds in (0, 1) of a `DitherTileSize`^2 tile, or nullptr to round to nearest
+const float *ditherThresholds(Dither dither) {
+    if (dither == Dither::Ordered) {
+        static const std::vector<float> tile = bayerTile();
+        return tile.data();
+    } else if (dither == Dither::BlueNoise) {
+        static const std::vector<float> tile = blueNoiseTile();
+        return tile.data();
+    }
+    return nullptr;
+}
+
+/* Values are clamped and scaled to [0, max], then offset by the dither
+   threshold (0.5 without dithering) and truncated. The same threshold is used
+   for all channels of a pixel. */
+template <typename T>
+void quantizePixels(const ConstPixelSpan &pixels, size_t n, T *dst, Dither dither, size_t i, size_t j) {
+    const float scale = float(std::numeric_limits<T>::max());
+    const float *thresholds = ditherThresholds(dither);
+    if (thresholds) thresholds += DitherTileSize * (i % DitherTileSize);
+
+    simd::dispatch([&](auto width) TONEMAPPER_SIMD_KERNEL {
+        typedef decltype(width) F;
+        if constexpr (std::is_same<F, float>::value) {
+            for (size_t k = 0; k < n; ++k) {
+                float t = thresholds ? thresholds[(j + k) % DitherTileSize] : 0.5f;
+                Color3f c = pixels.get(k);
+                for (size_t ch = 0; ch < 3; ++ch) {
+                    float v = std::min(1.f, std::max(0.f, c[ch]));
+                    dst[3 * k + ch] = T(v * scale + t);
+                }
+            }
+        } else {
+#if defined(TONEMAPPER_SIMD_ENABLED)
+            typedef simd::Mask<F> I;
+            constexpr size_t Width = sizeof(F) / sizeof(float);
+            for (size_t k = 0; k < n; k += Width) {
+                size_t count = std::min(Width, n - k);
+                simd::Color3v<F> c = simd::loadPixels<F>(pixels, k, count);
+
+                F t = F{} + 0.5f;
+                size_t column = (j + k) % DitherTileSize;
+                if (thresholds && column + Width <= DitherTileSize) {
+                    std::memcpy(&t, thresholds + column, sizeof(F));
+                } else if (thresholds) {
+                    float values[Width];
+                    for (size_t l = 0; l < Width; ++l) {
+                        values[l] = thresholds[(column + l) % DitherTileSize];
+                    }
+                    std::memcpy(&t, values, sizeof(F));
+                }
+
+                int32_t values[3][Width];
+                for (size_t ch = 0; ch < 3; ++ch) {
+                    F v = simd::min(F{} + 1.f, simd::max(F{}, c.c[ch]));
+                    I q = __builtin_convertvector(v * scale + t, I);
+                    std::memcpy(values[ch], &q, sizeof(I));
+                }
+                T *out = dst + 3 * k;
+                for (size_t l = 0; l < count; ++l) {
+                    out[3 * l + 0] = T(values[0][l]);
+                    out[3 * l + 1] = T(values[1][l]);
+                    out[3 * l + 2] = T(values[2][l]);
+                }
+            }
+#endif
+        }
+    });
+}
+
+} // Anonymous namespace
+
+void Image::quantize(const ConstPixelSpan &pixels, size_t n, uint8_t *dst, Dither dither, size_t i, size_t j) {
+    quantizePixels(pixels, n, dst, dither, i, j);
+}
+
+void Image::quantize(const ConstPixelSpan &pixels, size_t n, uint16_t *dst, Dither dither, size_t i, size_t j) {
+    quantizePixels(pixels, n, dst, dither, i, j);
+}
+
+void Image::saveLDR(const std::string &filename, const uint8_t *rgb8, size_t width, size_t height,
+                    const SaveOptions &options) {
     std::string out = filename;
     bool saveAsJpg;
 
-    std::string extension = std::filesystem::path(filename).extension().string();
+    std::string extension = saveFormat(filename, options);
     if (extension == ".jpg") {
         saveAsJpg = true;
     } else if (extension == ".png") {
@@ -176,47 +1879,48 @@ void Image::save(const std::string &filename) const {
     } else if (extension == "") {
         // No extension provided, automatically save as .jpg
         saveAsJpg = true;
-        out += ".jpg";
+        if (filename != "-") {
+            out += ".jpg";
+        }
     } else {
         PRINT("");
-        WARN("Image::save(): Invalid file extension in \"%s\". Can only save as either \".png\" or \".jpg\" format.", filename);
+        WARN("Image::save(): Invalid file extension in \"%s\". Can only save 8-bit images in \".png\" or \".jpg\" format.", filename);
         return;
     }
 
-    uint8_t *rgb8 = new uint8_t[3 * m_width * m_height];
-    uint8_t *dst = rgb8;
-
-    float *data = (float *) m_pixels.get();
-    for (size_t i = 0; i < m_height; ++i) {
-        for (size_t j = 0; j < m_width; ++j) {
-            size_t idx = i*m_width + j;
-            for (size_t ch = 0; ch < 3; ++ch) {
-
-                /* At this point, any tonemapping operator
-                   should already be applied, so we just
-                   save the raw data. */
-                float v = data[3*idx + ch];
-                v = std::min(1.f, std::max(0.f, v));
-                dst[0] = uint8_t(255.f * v);
-                dst++;
-            }
-        }
-    }
-
-    int ret;
-
+    bool success;
     if (saveAsJpg) {
-        ret = stbi_write_jpg(out.c_str(), int(m_width), int(m_height), 3, rgb8, 100);
+        success = encodeJPEG(out, rgb8, width, height, options.jpegQuality, options.jpegSubsampling);
     } else {
-        ret = stbi_write_png(out.c_str(), int(m_width), int(m_height), 3, rgb8, 3 * int(m_width));
+        success = encodePNG(out, rgb8, width, height, 8, options.pngCompression);
     }
 
-    if (ret == 0) {
+    if (!success) {
         PRINT("");
         WARN("save(): Could not save file \"%s\"", out);
     }
+}
+
+void Image::saveLDR(const std::string &filename, const uint16_t *rgb16, size_t width, size_t height,
+                    const SaveOptions &options) {
+    bool success;
+    std::string extension = saveFormat(filename, options);
+    if (extension == ".png") {
+        success = encodePNG(filename, rgb16, width, height, 16, options.pngCompression);
+    } else if (extension == ".tif" || extension == ".tiff") {
+        success = encodeTIFF(filename, rgb16, width, height);
+    } else if (extension == ".ppm") {
+        success = encodePPM(filename, rgb16, width, height);
+    } else {
+        PRINT("");
+        WARN("Image::save(): Invalid file extension in \"%s\". Can only save 16-bit images in \".png\", \".tif\" or \".ppm\" format.", filename);
+        return;
+    }
 
-    delete[] rgb8;
+    if (!success) {
+        PRINT("");
+        WARN("save(): Could not save file \"%s\"", filename);
+    }
 }
 
 const Color3f &Image::ref(size_t i, size_t j) const {
@@ -224,49 +1928,39 @@ const Color3f &Image::ref(size_t i, size_t j) const {
 }
 
 Color3f &Image::ref(size_t i, size_t j) {
+    m_statistics.invalidate();
     return m_pixels[m_width * i + j];
 }
 
-void Image::precompute() {
-    m_minimumLuminance =  std::numeric_limits<float>::infinity();
-    m_maximumLuminance = -std::numeric_limits<float>::infinity();
-    m_meanLuminance = 0.f;
-    m_logMeanLuminance = 0.f;
-    m_mean = Color3f(0.f);
-    m_max  = Color3f(-std::numeric_limits<float>::infinity());
+Color3f Image::get(size_t i, size_t j) const {
+    return row(i, j).get(0);
+}
 
-    size_t N = 0;
-    for (size_t i = 0; i < m_height; ++i) {
-        for (size_t j = 0; j < m_width; ++j) {
-            const Color3f &color = ref(i, j);
-            m_mean += color;
-            m_max = max(m_max, color);
-
-            float L = luminance(color);
-            m_minimumLuminance = std::min(m_minimumLuminance, L);
-            m_maximumLuminance = std::max(m_maximumLuminance, L);
-            m_meanLuminance += L;
-
-            if (L > 0.f) {
-                /* Be careful here as the log is only defined for non-zero
-                   luminance values.
-                   "Image Processing Techniques" by McReynolds et al. 2005
-                   suggest to alternatively add a small `delta` biasing term to
-                   avoid log(0), but this is not sufficient in case the image
-                   contains many black pixels. */
-                m_logMeanLuminance += std::log(L);
-                N++;
-            }
-        }
+void Image::set(size_t i, size_t j, const Color3f &c) {
+    row(i, j).set(0, c);
+}
+
+PixelSpan Image::row(size_t i, size_t j) {
+    m_statistics.invalidate();
+    if (m_layout == PixelLayout::Interleaved) {
+        return PixelSpan(m_pixels + m_width * i + j);
+    }
+    size_t offset = m_rowStride * i + j;
+    if (m_layout == PixelLayout::PlanarHalf) {
+        return PixelSpan(m_halfPlanes[0] + offset, m_halfPlanes[1] + offset, m_halfPlanes[2] + offset);
     }
-    m_mean /= float(m_height * m_width);
-    m_meanLuminance /= float(m_height * m_width);
+    return PixelSpan(m_planes[0] + offset, m_planes[1] + offset, m_planes[2] + offset, 1);
+}
 
-    /* Eq. (1) in Eq. (1) in "Photographic Tone Reproduction for Digital Images"
-       by Reinhard et al. 2002. divides by N after exponentiating. But this does not
-       give sensible values here. Instead, the whole expression should be equivalent
-       to computing a geometric mean. */
-    m_logMeanLuminance = std::exp(m_logMeanLuminance / N);
+ConstPixelSpan Image::row(size_t i, size_t j) const {
+    if (m_layout == PixelLayout::Interleaved) {
+        return ConstPixelSpan(m_pixels + m_width * i + j);
+    }
+    size_t offset = m_rowStride * i + j;
+    if (m_layout == PixelLayout::PlanarHalf) {
+        return ConstPixelSpan(m_halfPlanes[0] + offset, m_halfPlanes[1] + offset, m_halfPlanes[2] + offset);
+    }
+    return ConstPixelSpan(m_planes[0] + offset, m_planes[1] + offset, m_planes[2] + offset, 1);
 }
 
 } // Namespace tonemapper
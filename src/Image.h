@@ -9,35 +9,273 @@
 
 #include <Global.h>
 #include <Color.h>
+#include <Half.h>
+#include <Statistics.h>
 
+#include <functional>
 #include <memory>
+#include <type_traits>
 
 namespace tonemapper {
 
+// Memory layout of the pixels of an `Image`
+enum class PixelLayout {
+    Interleaved = 0,    // One `Color3f` per pixel
+    Planar,             // Separate R, G, B planes with aligned, padded rows
+    PlanarHalf          // Like `Planar`, but stored as IEEE half floats
+};
+
+// Options for `Image::load`
+struct LoadOptions {
+    PixelLayout layout = PixelLayout::Interleaved;
+
+    /* Part of a multi-part EXR file, given by its name or index. Only this part
+       is decoded, an empty string selects the first one. */
+    std::string part;
+
+    /* Channels of ".exr" files that are read as red, green and blue, e.g.
+       "diffuse.R,diffuse.G,diffuse.B". A single name selects either one
+       channel, which is read as gray, or a layer with ".R", ".G" and ".B"
+       channels. By default, the "R", "G" and "B" channels are read, or those
+       of the first layer that has all three. */
+    std::string channels;
+
+    /* Read the display window of ".exr" files instead of their data window,
+       pixels outside of the data window are black. The region of interest
+       is then given in pixels of the display window. */
+    bool displayWindow = false;
+
+    /* Resolution of headerless ".raw" files (and raw data on standard input),
+       which hold interleaved RGB floats in native byte order, top row first. */
+    size_t rawWidth = 0, rawHeight = 0;
+
+    // ".raw" files hold half instead of full precision floats
+    bool rawHalf = false;
+
+    /* Region of interest in pixels of the image (the data window of ".exr"
+       files), clamped to its bounds. A width or height of 0 extends it to
+       the right or bottom border. Only the data that covers the region is
+       decoded. */
+    size_t roiX = 0, roiY = 0, roiWidth = 0, roiHeight = 0;
+
+    /* Reduce the resolution of the region by this integer factor, averaging
+       blocks of `downsample` x `downsample` pixels while decoding. Tiled
+       ".exr" files are read from their mip or rip levels where possible. */
+    size_t downsample = 1;
+};
+
+/* Dithering applied when quantizing to 8 or 16 bits. It trades the banding
+   of smooth gradients for fine noise. */
+enum class Dither {
+    None = 0,           // Round to nearest
+    Ordered,            // 8 x 8 Bayer matrix
+    BlueNoise           // 64 x 64 blue noise tile
+};
+
+// Chroma subsampling of ".jpg" files
+enum class ChromaSubsampling {
+    Chroma444 = 0,      // Full color resolution
+    Chroma422,          // Half horizontal color resolution
+    Chroma420           // Half horizontal and vertical color resolution
+};
+
+// Options for `Image::save` and `Image::saveLDR`
+struct SaveOptions {
+    /* Deflate level of ".png" files. Level 0 stores the data uncompressed and
+       level 1 only encodes runs of repeated bytes, both are meant for quick
+       previews. Levels 2-9 trade speed for file size like the zlib levels. */
+    int pngCompression = 4;
+
+    // Quality of ".jpg" files in [1, 100], and their chroma subsampling
+    int jpegQuality = 100;
+    ChromaSubsampling jpegSubsampling = ChromaSubsampling::Chroma444;
+
+    /* Bits per channel of ".png" files, either 8 or 16. ".tif" and ".ppm" files
+       always use 16 bits, ".jpg" files 8 bits. */
+    int bitDepth = 8;
+
+    // Store ".exr" files as half instead of full precision floats
+    bool exrHalf = true;
+
+    // Dithering of all quantized formats
+    Dither dither = Dither::None;
+
+    // Store ".raw" files as half instead of full precision floats
+    bool rawHalf = false;
+
+    /* File format as an extension (e.g. ".png"), which overrides the one of the
+       filename. Needed to write to standard output, given by the filename "-". */
+    std::string format;
+};
+
+/* Non-owning view of consecutive pixels in one image row. The three channels
+   are either interleaved (stride 3) or come from separate planes (stride 1),
+   so the same code can read and write both layouts without copying. Planes
+   of half floats are referenced by `halfChannels` instead of `channels`, and
+   are converted on access. */
+template <typename Float>
+struct BasicPixelSpan {
+    typedef typename std::conditional<std::is_const<Float>::value, const Color3f, Color3f>::type Color;
+    typedef typename std::conditional<std::is_const<Float>::value, const uint16_t, uint16_t>::type Half;
+
+    BasicPixelSpan(Float *r, Float *g, Float *b, size_t stride)
+        : channels{r, g, b}, halfChannels{nullptr, nullptr, nullptr}, stride(stride) {}
+
+    // View of interleaved `Color3f` pixels
+    BasicPixelSpan(Color *pixels)
+        : BasicPixelSpan((Float *) pixels, (Float *) pixels + 1, (Float *) pixels + 2, 3) {}
+
+    // View of planes of half floats
+    BasicPixelSpan(Half *r, Half *g, Half *b)
+        : channels{nullptr, nullptr, nullptr}, halfChannels{r, g, b}, stride(1) {}
+
+    // Allow passing a mutable span where a read-only one is expected
+    template <typename Other>
+    BasicPixelSpan(const BasicPixelSpan<Other> &other)
+        : channels{other.channels[0], other.channels[1], other.channels[2]},
+          halfChannels{other.halfChannels[0], other.halfChannels[1], other.halfChannels[2]},
+          stride(other.stride) {}
+
+    inline Color3f get(size_t i) const {
+        if (isHalf()) {
+            return Color3f(halfToFloat(halfChannels[0][i]), halfToFloat(halfChannels[1][i]), halfToFloat(halfChannels[2][i]));
+        }
+        return Color3f(channels[0][i * stride], channels[1][i * stride], channels[2][i * stride]);
+    }
+
+    inline void set(size_t i, const Color3f &c) const {
+        if (isHalf()) {
+            halfChannels[0][i] = floatToHalf(c.r());
+            halfChannels[1][i] = floatToHalf(c.g());
+            halfChannels[2][i] = floatToHalf(c.b());
+            return;
+        }
+        channels[0][i * stride] = c.r();
+        channels[1][i * stride] = c.g();
+        channels[2][i * stride] = c.b();
+    }
+
+    inline bool isPlanar() const { return stride == 1; }
+    inline bool isHalf() const { return halfChannels[0] != nullptr; }
+
+    Float *channels[3];
+    Half *halfChannels[3];
+    size_t stride;
+};
+
+typedef BasicPixelSpan<float>       PixelSpan;
+typedef BasicPixelSpan<const float> ConstPixelSpan;
+
 class Image {
 public:
-    Image(size_t width, size_t height);
+    Image(size_t width, size_t height, PixelLayout layout = PixelLayout::Interleaved);
+
+    /* Adopt pixel memory that was allocated elsewhere (e.g. by an image
+       decoder) instead of copying it. `release` is called to free the memory
+       once the image no longer uses it.
+       The first version wraps interleaved `Color3f` pixels. The others wrap
+       three float or half planes with `rowStride` values between rows, which
+       can be arbitrary channels of the decoded data but must not overlap. */
+    Image(size_t width, size_t height, Color3f *pixels, std::function<void()> release);
+    Image(size_t width, size_t height, float *const planes[3], size_t rowStride, std::function<void()> release);
+    Image(size_t width, size_t height, uint16_t *const planes[3], size_t rowStride, std::function<void()> release);
+
     ~Image();
 
-    void precompute();
+    Image(const Image &) = delete;
+    Image &operator=(const Image &) = delete;
+
+    /* Compute the image statistics below right away. Otherwise they are only
+       computed on first access. */
+    void precompute() const { m_statistics.precompute(); }
 
-    static Image *load(const std::string &filename);
-    void save(const std::string &filename) const;
+    /* Load an ".exr", ".hdr", ".pfm" or ".raw" file. The filename "-" reads
+       from standard input instead, where the format is detected from the
+       data (or assumed to be raw if `LoadOptions::rawWidth` is set). */
+    static Image *load(const std::string &filename, const LoadOptions &options);
+    static Image *load(const std::string &filename, PixelLayout layout = PixelLayout::Interleaved) {
+        LoadOptions options;
+        options.layout = layout;
+        return load(filename, options);
+    }
 
-    float *getData() { return (float *) m_pixels.get(); }
+    // Read only the resolution of an image file, returns false on failure
+    static bool readSize(const std::string &filename, size_t &width, size_t &height);
 
+    /* Save in ".png", ".jpg", ".tif", ".ppm", ".exr", ".pfm" or ".raw" format,
+       depending on the extension of `filename`. All but the floating point
+       formats (".exr", ".pfm" and ".raw") are clamped to [0, 1] and quantized
+       first. */
+    void save(const std::string &filename, const SaveOptions &options = SaveOptions()) const;
+
+    /* Bits per channel that `save` quantizes to for `filename`, or 0 for
+       floating point files */
+    static int getBitDepth(const std::string &filename, const SaveOptions &options);
+
+    /* Clamp `n` pixels to [0, 1] and round them to 8-bit or 16-bit RGB, using
+       the vector width of the active `SimdLevel`. `i` and `j` are the image
+       coordinates of the first pixel, which select the dither thresholds. */
+    static void quantize(const ConstPixelSpan &pixels, size_t n, uint8_t *dst,
+                         Dither dither = Dither::None, size_t i = 0, size_t j = 0);
+    static void quantize(const ConstPixelSpan &pixels, size_t n, uint16_t *dst,
+                         Dither dither = Dither::None, size_t i = 0, size_t j = 0);
+
+    /* Encode 8-bit RGB data (`3 * width` bytes per row) in ".png" or ".jpg"
+       format, depending on the extension of `filename`. Both encoders split
+       the image into bands of rows that are compressed in parallel. */
+    static void saveLDR(const std::string &filename, const uint8_t *rgb8, size_t width, size_t height,
+                        const SaveOptions &options = SaveOptions());
+
+    /* Same for 16-bit RGB data in ".png", ".tif" or ".ppm" format. TIFF files
+       are uncompressed, with one strip per band. */
+    static void saveLDR(const std::string &filename, const uint16_t *rgb16, size_t width, size_t height,
+                        const SaveOptions &options = SaveOptions());
+
+    inline PixelLayout getLayout() const { return m_layout; }
+
+    // Convert the pixel data to a different layout (no-op if it already matches)
+    void setLayout(PixelLayout layout);
+
+    /* Raw interleaved RGB data, only available for `PixelLayout::Interleaved`.
+       Like all other non-const accessors, the mutable version discards the
+       cached statistics. */
+    float *getData() { m_statistics.invalidate(); return (float *) m_pixels; }
+    const float *getData() const { return (const float *) m_pixels; }
+
+    /* Start of channel plane `ch` and distance between rows (in values), only
+       available for `PixelLayout::Planar` and `PixelLayout::PlanarHalf`
+       respectively. Planes and rows are aligned to 64 bytes, unless the memory
+       was adopted from elsewhere. */
+    float *getPlane(size_t ch) { m_statistics.invalidate(); return m_planes[ch]; }
+    const float *getPlane(size_t ch) const { return m_planes[ch]; }
+    uint16_t *getHalfPlane(size_t ch) { m_statistics.invalidate(); return m_halfPlanes[ch]; }
+    const uint16_t *getHalfPlane(size_t ch) const { return m_halfPlanes[ch]; }
+    inline size_t getRowStride() const { return m_rowStride; }
+
+    // Direct access to a pixel, only available for `PixelLayout::Interleaved`
     const Color3f &ref(size_t i, size_t j) const;
     Color3f &ref(size_t i, size_t j);
 
+    // Layout independent access to a pixel
+    Color3f get(size_t i, size_t j) const;
+    void set(size_t i, size_t j, const Color3f &c);
+
+    // Layout independent view of row `i`, starting at column `j`
+    PixelSpan row(size_t i, size_t j = 0);
+    ConstPixelSpan row(size_t i, size_t j = 0) const;
+
     inline size_t getWidth() const { return m_width; }
     inline size_t getHeight() const { return m_height; }
 
-    inline Color3f getMean()    const { return m_mean; }
-    inline Color3f getMaximum() const { return m_max; }
-    inline float getMinimumLuminance() const { return m_minimumLuminance; }
-    inline float getMaximumLuminance() const { return m_maximumLuminance; }
-    inline float getMeanLuminance() const { return m_meanLuminance; }
-    inline float getLogMeanLuminance() const { return m_logMeanLuminance; }
+    // Lazily computed statistics of the pixels, see `ImageStatistics`
+    inline const ImageStatistics &statistics() const { return m_statistics; }
+
+    inline Color3f getMean()    const { return m_statistics.getMean(); }
+    inline Color3f getMaximum() const { return m_statistics.getMaximum(); }
+    inline float getMinimumLuminance() const { return m_statistics.getMinimumLuminance(); }
+    inline float getMaximumLuminance() const { return m_statistics.getMaximumLuminance(); }
+    inline float getMeanLuminance() const { return m_statistics.getMeanLuminance(); }
+    inline float getLogMeanLuminance() const { return m_statistics.getLogMeanLuminance(); }
 
     inline const std::string &getFilename() const { return m_filename; };
     inline void setFilename(const std::string &filename) { m_filename = filename; }
@@ -45,16 +283,19 @@ public:
 private:
     // Image data
     size_t m_width, m_height;
-    std::unique_ptr<Color3f[]> m_pixels;
+    PixelLayout m_layout;
+    std::unique_ptr<Color3f[]> m_pixelStorage;
+    Color3f *m_pixels = nullptr;
+    std::unique_ptr<float[]> m_planeStorage;
+    float *m_planes[3] = { nullptr, nullptr, nullptr };
+    std::unique_ptr<uint16_t[]> m_halfStorage;
+    uint16_t *m_halfPlanes[3] = { nullptr, nullptr, nullptr };
+    size_t m_rowStride = 0;
+    std::function<void()> m_release;    // Frees adopted memory, if any
     std::string m_filename;
 
-    // Precomputed values used by some operators
-    Color3f m_mean,
-            m_max;
-    float m_minimumLuminance,
-          m_maximumLuminance,
-          m_meanLuminance,
-          m_logMeanLuminance;
+    // Values used by some operators, computed on first access
+    ImageStatistics m_statistics{*this};
 };
 
 } // Namespace tonemapper
@@ -0,0 +1,552 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <Lut.h>
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace tonemapper {
+
+namespace {
+
+/* Dynamic range covered logarithmically by the 1D curves and the (much
+   coarser) 3D table. Darker values are interpolated linearly towards 0. */
+constexpr float CurveOctaves = 24.f;
+constexpr float CubeOctaves  = 20.f;
+
+/* Exposed colors of `colors` are overwritten with their (exact) tonemapped
+   versions. Several operators also scale their parameters by the exposure, so
+   they are evaluated for the unexposed input and the actual exposure. */
+void evaluate(const TonemapOperator &op, float exposure, std::vector<Color3f> &colors) {
+    constexpr size_t BatchSize = 4096;
+    size_t batches = (colors.size() + BatchSize - 1) / BatchSize;
+    ThreadPool::get().parallelFor(batches, [&](size_t batch) {
+        size_t first = batch * BatchSize,
+               n     = std::min(BatchSize, colors.size() - first);
+        for (size_t i = first; i < first + n; ++i) {
+            colors[i] = colors[i] / exposure;
+        }
+        op.mapSpan(&colors[first], &colors[first], n, exposure);
+    });
+}
+
+/* Table indices of a single value or of all lanes of a vector, with the
+   conversions that are needed to interpolate between table entries */
+template <typename F> struct LaneIndex;
+
+template <> struct LaneIndex<float> {
+    typedef int32_t Type;
+
+    static TONEMAPPER_SIMD_INLINE Type fromPosition(float position, int32_t last) {
+        return std::min(int32_t(position), last);
+    }
+    static TONEMAPPER_SIMD_INLINE float toFloat(Type index) { return float(index); }
+    static TONEMAPPER_SIMD_INLINE float fetch(const float *table, Type index) { return table[index]; }
+};
+
+#if defined(TONEMAPPER_SIMD_ENABLED)
+template <typename F> struct LaneIndex {
+    typedef simd::Mask<F> Type;
+
+    static TONEMAPPER_SIMD_INLINE Type fromPosition(F position, int32_t last) {
+        Type index = __builtin_convertvector(position, Type),
+             limit = Type{} + last,
+             mask  = index < limit;
+        return (index & mask) | (limit & ~mask);
+    }
+    static TONEMAPPER_SIMD_INLINE F toFloat(Type index) { return __builtin_convertvector(index, F); }
+
+    static TONEMAPPER_SIMD_INLINE F fetch(const float *table, Type index) {
+        return simd::gather<F>(table, index);
+    }
+};
+#endif
+
+// Curve as interleaved entries and differences to the next ones
+std::vector<float> interleave(const std::vector<float> &values) {
+    std::vector<float> curve(2 * values.size());
+    for (size_t k = 0; k < values.size(); ++k) {
+        curve[2 * k]     = values[k];
+        curve[2 * k + 1] = k + 1 < values.size() ? values[k + 1] - values[k] : 0.f;
+    }
+    return curve;
+}
+
+/* Smallest value in [0, range] from which on the non-decreasing function `f`
+   stays at (or above) `limit`, or `range` if it does not reach it. */
+template <typename Function>
+float saturation(const Function &f, float range, float limit) {
+    if (!(f(range) >= limit)) {
+        return range;
+    }
+    float low = 0.f, high = range;
+    for (int i = 0; i < 64; ++i) {
+        float middle = 0.5f * (low + high);
+        if (middle <= low || middle >= high) break;
+        if (f(middle) >= limit) {
+            high = middle;
+        } else {
+            low = middle;
+        }
+    }
+    return high;
+}
+
+inline float deviation(const Color3f &a, const Color3f &b) {
+    return std::max(std::abs(a[0] - b[0]), std::max(std::abs(a[1] - b[1]), std::abs(a[2] - b[2])));
+}
+
+} // Anonymous namespace
+
+LutShaper::LutShaper(float range, float octaves, size_t size)
+    : m_size(std::max(size, size_t(3))) {
+    // Keep the whole logarithmic part within normalized floats
+    m_range = std::max(range, std::ldexp(FLT_MIN, int(std::ceil(octaves))));
+    m_minimum = m_range * std::exp2(-octaves);
+    m_invMinimum = 1.f / m_minimum;
+
+    int32_t rangeBits;
+    memcpy(&m_minimumBits, &m_minimum, 4);
+    memcpy(&rangeBits, &m_range, 4);
+    m_scale = float(m_size - 2) / float(rangeBits - m_minimumBits);
+}
+
+float LutShaper::value(float position) const {
+    if (position <= 1.f) {
+        return std::max(position, 0.f) * m_minimum;
+    }
+    if (position >= float(m_size - 1)) {
+        return m_range;
+    }
+
+    // Exponent and mantissa of the interpolated bit pattern
+    double bits = double(m_minimumBits) + double(position - 1.f) / double(m_scale),
+           exponent = std::floor(bits / double(1 << 23));
+    return float(std::ldexp(1.0 + bits / double(1 << 23) - exponent, int(exponent) - 127));
+}
+
+BakedOperator::BakedOperator(const TonemapOperator &op, float exposure, float range, size_t curveSize, size_t cubeSize)
+    : TonemapOperator() {
+    name        = op.name;
+    description = op.description;
+    tileSize    = op.tileSize;
+    traits      = op.traits;
+
+    const OperatorTraits &t = op.traits;
+    bool saturates = t.monotonic && std::isfinite(t.outputMax);
+    std::vector<Color3f> samples, centers;
+    if (t.separable) {
+        m_layout = Layout::Curves;
+        if (saturates) {
+            auto minimum = [&](float x) {
+                Color3f c = op.map(Color3f(x / exposure), exposure);
+                return std::min(c[0], std::min(c[1], c[2]));
+            };
+            m_saturated = minimum(range) >= t.outputMax;
+            range = saturation(minimum, range, t.outputMax);
+        }
+        m_shaper = LutShaper(range, CurveOctaves, curveSize);
+        size_t size = m_shaper.getSize();
+        for (size_t k = 0; k < size; ++k) {
+            samples.push_back(Color3f(m_shaper.value(float(k))));
+        }
+        for (size_t k = 0; k + 1 < size; ++k) {
+            centers.push_back(Color3f(m_shaper.value(float(k) + 0.5f)));
+        }
+        evaluate(op, exposure, samples);
+        for (size_t ch = 0; ch < 3; ++ch) {
+            std::vector<float> values(size);
+            for (size_t k = 0; k < size; ++k) {
+                values[k] = samples[k][ch];
+            }
+            m_curves[ch] = interleave(values);
+        }
+    } else if (t.luminanceScaled) {
+        m_layout = Layout::Luminance;
+
+        // Ratio of tonemapped and original luminance, its limit towards 0 first
+        m_shaper = LutShaper(range, CurveOctaves, curveSize);
+        size_t size = m_shaper.getSize();
+        std::vector<float> ratios(size), mapped(size);
+        float maxLuminance = 0.f;
+        for (size_t k = 1; k < size; ++k) {
+            float L = m_shaper.value(float(k)),
+                  Lout = op.mapLuminance(L, exposure);
+            ratios[k] = Lout / L;
+            mapped[k] = Lout;
+            if (Lout > maxLuminance) maxLuminance = Lout;
+        }
+        ratios[0] = ratios[1];
+        m_curves[0] = interleave(ratios);
+
+        /* Scaled channels are at most the tonemapped luminance divided by the
+           smallest luminance weight (of blue) */
+        float displayRange = maxLuminance / luminance(Color3f(0.f, 0.f, 1.f));
+        if (!std::isfinite(displayRange) || displayRange <= 0.f) {
+            displayRange = range;
+        }
+        if (saturates) {
+            displayRange = saturation([&](float x) { return op.mapDisplay(x); }, displayRange, t.outputMax);
+        }
+        m_displayShaper = LutShaper(displayRange, CurveOctaves, curveSize);
+        std::vector<float> display(m_displayShaper.getSize());
+        for (size_t k = 0; k < display.size(); ++k) {
+            display[k] = op.mapDisplay(m_displayShaper.value(float(k)));
+        }
+        m_curves[1] = interleave(display);
+
+        /* Gray colors between the entries of both curves, and a grid of mixed
+           colors. Gray inputs whose tonemapped luminance falls between two
+           display entries are found by inverting the luminance curve
+           linearly within each of its cells. */
+        constexpr size_t Levels = 16;
+        for (size_t k = 0; k + 1 < size; ++k) {
+            centers.push_back(Color3f(m_shaper.value(float(k) + 0.5f)));
+        }
+        std::vector<float> middles(m_displayShaper.getSize() - 1);
+        for (size_t k = 0; k < middles.size(); ++k) {
+            middles[k] = m_displayShaper.value(float(k) + 0.5f);
+        }
+        for (size_t k = 0; k + 1 < size; ++k) {
+            float L0 = m_shaper.value(float(k)),
+                  L1 = m_shaper.value(float(k + 1)),
+                  y0 = mapped[k],
+                  y1 = mapped[k + 1];
+            if (y0 == y1 || !std::isfinite(y1 - y0)) continue;
+            auto first = std::lower_bound(middles.begin(), middles.end(), std::min(y0, y1));
+            for (auto it = first; it != middles.end() && *it <= std::max(y0, y1); ++it) {
+                float t = (*it - y0) / (y1 - y0);
+                centers.push_back(Color3f(L0 + t * (L1 - L0)));
+            }
+        }
+        std::vector<float> levels(Levels);
+        for (size_t k = 0; k < Levels; ++k) {
+            levels[k] = m_shaper.value((float(k) + 0.5f) * float(size - 1) / float(Levels));
+        }
+        for (size_t r = 0; r < Levels; ++r) {
+            for (size_t g = 0; g < Levels; ++g) {
+                for (size_t b = 0; b < Levels; ++b) {
+                    centers.push_back(Color3f(levels[r], levels[g], levels[b]));
+                }
+            }
+        }
+    } else {
+        m_layout = Layout::Cube;
+        m_shaper = LutShaper(range, CubeOctaves, cubeSize);
+        size_t size = m_shaper.getSize();
+        std::vector<float> values(size), middles(size - 1);
+        for (size_t k = 0; k < size; ++k) {
+            values[k] = m_shaper.value(float(k));
+            if (k + 1 < size) middles[k] = m_shaper.value(float(k) + 0.5f);
+        }
+        for (size_t b = 0; b < size; ++b) {
+            for (size_t g = 0; g < size; ++g) {
+                for (size_t r = 0; r < size; ++r) {
+                    samples.push_back(Color3f(values[r], values[g], values[b]));
+                    if (r + 1 < size && g + 1 < size && b + 1 < size) {
+                        centers.push_back(Color3f(middles[r], middles[g], middles[b]));
+                    }
+                }
+            }
+        }
+        evaluate(op, exposure, samples);
+        m_cube = std::move(samples);
+    }
+
+    // Between the entries, where the interpolation is furthest off
+    std::vector<Color3f> exact = centers;
+    evaluate(op, exposure, exact);
+    for (size_t i = 0; i < centers.size(); ++i) {
+        float error = deviation(lookup(centers[i]), exact[i]);
+        if (error > m_maxError) m_maxError = error;
+    }
+}
+
+template <typename Color>
+TONEMAPPER_SIMD_INLINE Color BakedOperator::interpolateColor(const Color &c) const {
+    typedef typename std::decay<decltype(c.r())>::type F;
+    typedef LaneIndex<F> Index;
+
+    size_t size = m_shaper.getSize();
+    if (m_layout == Layout::Luminance) {
+        F ratio = simd::interpolate(m_curves[0].data(), size, m_shaper.position(luminance(c)));
+        const LutShaper &display = m_displayShaper;
+        size_t displaySize = display.getSize();
+        return Color(simd::interpolate(m_curves[1].data(), displaySize, display.position(c.r() * ratio)),
+                     simd::interpolate(m_curves[1].data(), displaySize, display.position(c.g() * ratio)),
+                     simd::interpolate(m_curves[1].data(), displaySize, display.position(c.b() * ratio)));
+    }
+
+    F positions[3] = { m_shaper.position(c.r()), m_shaper.position(c.g()), m_shaper.position(c.b()) };
+    if (m_layout == Layout::Curves) {
+        return Color(simd::interpolate(m_curves[0].data(), size, positions[0]),
+                     simd::interpolate(m_curves[1].data(), size, positions[1]),
+                     simd::interpolate(m_curves[2].data(), size, positions[2]));
+    }
+
+    // Index of the first entry of the cell and position within it
+    typename Index::Type first = Index::fromPosition(F{}, 0);
+    F t[3];
+    for (int ch = 2; ch >= 0; --ch) {
+        F position = positions[ch];
+        auto k = Index::fromPosition(position, int32_t(size - 2));
+        t[ch] = position - Index::toFloat(k);
+        first = first * int32_t(size) + k;
+    }
+
+    // Trilinear interpolation, first along red, then green, then blue
+    const float *entries = (const float *) m_cube.data();
+    auto corner = [&](size_t r, size_t g, size_t b) TONEMAPPER_SIMD_KERNEL {
+        auto index = 3 * (first + int32_t((b * size + g) * size + r));
+        return Color(Index::fetch(entries, index),
+                     Index::fetch(entries, index + 1),
+                     Index::fetch(entries, index + 2));
+    };
+    auto alongRed = [&](size_t g, size_t b) TONEMAPPER_SIMD_KERNEL {
+        Color c0 = corner(0, g, b),
+              c1 = corner(1, g, b);
+        return c0 + t[0] * (c1 - c0);
+    };
+    auto alongGreen = [&](size_t b) TONEMAPPER_SIMD_KERNEL {
+        Color c0 = alongRed(0, b),
+              c1 = alongRed(1, b);
+        return c0 + t[1] * (c1 - c0);
+    };
+    Color c0 = alongGreen(0),
+          c1 = alongGreen(1);
+    return c0 + t[2] * (c1 - c0);
+}
+
+Color3f BakedOperator::lookup(const Color3f &c) const {
+    return interpolateColor(c);
+}
+
+void BakedOperator::mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const {
+    simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+        return interpolateColor(Cin);
+    });
+}
+
+namespace {
+
+/* Maps input values to positions in [0, 1] within the exported tables, by
+   the formula that the file formats apply (and not through the bit patterns
+   used by `LutShaper`). */
+struct ExportShaper {
+    bool logarithmic;
+    float minimum, maximum;
+
+    // Input value at a position in [0, 1]
+    float value(float t) const {
+        if (logarithmic) {
+            return std::exp2(lerp(t, std::log2(minimum), std::log2(maximum)));
+        }
+        return t * maximum;
+    }
+
+    // Position of an input value, clamped to [0, 1]
+    float position(float x) const {
+        float t = logarithmic ? inverseLerp(std::log2(std::max(x, minimum)), std::log2(minimum), std::log2(maximum))
+                              : x / maximum;
+        return std::clamp(t, 0.f, 1.f);
+    }
+};
+
+std::string escapeXml(const std::string &text) {
+    std::string result;
+    for (char c : text) {
+        switch (c) {
+            case '&': result += "&amp;"; break;
+            case '<': result += "&lt;"; break;
+            case '>': result += "&gt;"; break;
+            case '"': result += "&quot;"; break;
+            default:  result += c;
+        }
+    }
+    return result;
+}
+
+} // Anonymous namespace
+
+float exportLut(const TonemapOperator &op, float exposure, const std::string &filename,
+                const LutExportOptions &options) {
+    std::string extension = std::filesystem::path(filename).extension().string();
+    bool cube = extension == ".cube",
+         spi1d = extension == ".spi1d",
+         clf  = extension == ".clf";
+    if (!cube && !spi1d && !clf) {
+        ERROR("exportLut(): Unknown lookup table format \"%s\".", extension);
+    }
+    bool separable = op.traits.separable;
+    if (spi1d && !separable) {
+        ERROR("exportLut(): Operator \"%s\" does not map each channel on its own and needs a 3D table, which \".spi1d\" files cannot hold.", op.name);
+    }
+    if (!(options.maximum > 0.f) || options.minimum < 0.f || options.minimum >= options.maximum) {
+        ERROR("exportLut(): Invalid input range [%f, %f].", options.minimum, options.maximum);
+    }
+
+    /* Only the 3D tables of ".cube" files and all tables of ".clf" files get
+       the shaper */
+    bool logarithmic = options.shaper == LutShaperType::Log2 && (clf || !separable);
+    ExportShaper shaper = { logarithmic, options.minimum > 0.f ? options.minimum : options.maximum * std::exp2(-16.f), options.maximum };
+    if (!logarithmic) shaper.minimum = 0.f;
+
+    /* Entries at the positions k / (size - 1), and the points halfway between
+       them where the error of the interpolation is largest */
+    size_t size = std::max(separable ? options.curveSize : options.cubeSize, size_t(2));
+    std::vector<float> values(size), middles(size - 1);
+    for (size_t k = 0; k < size; ++k) {
+        values[k] = exposure * shaper.value(float(k) / float(size - 1));
+        if (k + 1 < size) middles[k] = exposure * shaper.value((float(k) + 0.5f) / float(size - 1));
+    }
+
+    std::vector<Color3f> entries, centers;
+    if (separable) {
+        for (size_t k = 0; k < size; ++k) {
+            entries.push_back(Color3f(values[k]));
+            if (k + 1 < size) centers.push_back(Color3f(middles[k]));
+        }
+    } else {
+        // Red changes fastest, as in ".cube" files
+        for (size_t b = 0; b < size; ++b) {
+            for (size_t g = 0; g < size; ++g) {
+                for (size_t r = 0; r < size; ++r) {
+                    entries.push_back(Color3f(values[r], values[g], values[b]));
+                    if (r + 1 < size && g + 1 < size && b + 1 < size) {
+                        centers.push_back(Color3f(middles[r], middles[g], middles[b]));
+                    }
+                }
+            }
+        }
+    }
+    evaluate(op, exposure, entries);
+    evaluate(op, exposure, centers);
+
+    // Interpolated values at the centers: averages of the neighboring entries
+    float maxError = 0.f;
+    size_t i = 0;
+    if (separable) {
+        for (size_t k = 0; k + 1 < size; ++k) {
+            Color3f interpolated = 0.5f * (entries[k] + entries[k + 1]);
+            maxError = std::max(maxError, deviation(interpolated, centers[i++]));
+        }
+    } else {
+        for (size_t b = 0; b + 1 < size; ++b) {
+            for (size_t g = 0; g + 1 < size; ++g) {
+                for (size_t r = 0; r + 1 < size; ++r) {
+                    Color3f interpolated(0.f);
+                    for (size_t corner = 0; corner < 8; ++corner) {
+                        size_t index = ((b + (corner >> 2)) * size + g + ((corner >> 1) & 1)) * size + r + (corner & 1);
+                        interpolated += entries[index];
+                    }
+                    maxError = std::max(maxError, deviation(interpolated / 8.f, centers[i++]));
+                }
+            }
+        }
+    }
+
+    std::ostringstream out;
+    if (cube) {
+        tfm::format(out, "# %s, exposure = %f\n", op.name, exposure);
+        tfm::format(out, "TITLE \"%s\"\n", op.name);
+        if (separable) {
+            tfm::format(out, "LUT_1D_SIZE %d\n", size);
+            tfm::format(out, "DOMAIN_MIN 0.0 0.0 0.0\n");
+            tfm::format(out, "DOMAIN_MAX %f %f %f\n", shaper.maximum, shaper.maximum, shaper.maximum);
+        } else if (logarithmic) {
+            // The shaper table maps the input range to [0, 1]
+            size_t shaperSize = std::max(options.curveSize, size_t(2));
+            tfm::format(out, "LUT_1D_SIZE %d\n", shaperSize);
+            tfm::format(out, "LUT_1D_INPUT_RANGE 0.0 %f\n", shaper.maximum);
+            tfm::format(out, "LUT_3D_SIZE %d\n", size);
+            tfm::format(out, "LUT_3D_INPUT_RANGE 0.0 1.0\n");
+            for (size_t k = 0; k < shaperSize; ++k) {
+                float t = shaper.position(float(k) / float(shaperSize - 1) * shaper.maximum);
+                tfm::format(out, "%f %f %f\n", t, t, t);
+            }
+        } else {
+            tfm::format(out, "LUT_3D_SIZE %d\n", size);
+            tfm::format(out, "DOMAIN_MIN 0.0 0.0 0.0\n");
+            tfm::format(out, "DOMAIN_MAX %f %f %f\n", shaper.maximum, shaper.maximum, shaper.maximum);
+        }
+        for (const Color3f &c : entries) {
+            tfm::format(out, "%f %f %f\n", c[0], c[1], c[2]);
+        }
+    } else if (spi1d) {
+        tfm::format(out, "Version 1\n");
+        tfm::format(out, "From 0.0 %f\n", shaper.maximum);
+        tfm::format(out, "Length %d\n", size);
+        tfm::format(out, "Components 3\n");
+        tfm::format(out, "{\n");
+        for (const Color3f &c : entries) {
+            tfm::format(out, "    %f %f %f\n", c[0], c[1], c[2]);
+        }
+        tfm::format(out, "}\n");
+    } else {
+        std::string bitDepths = "inBitDepth=\"32f\" outBitDepth=\"32f\"";
+        auto range = [&](float minIn, float maxIn, float minOut, float maxOut) {
+            tfm::format(out, "    <Range %s>\n", bitDepths);
+            tfm::format(out, "        <minInValue>%.9g</minInValue>\n", minIn);
+            if (maxIn > minIn) tfm::format(out, "        <maxInValue>%.9g</maxInValue>\n", maxIn);
+            tfm::format(out, "        <minOutValue>%.9g</minOutValue>\n", minOut);
+            if (maxIn > minIn) tfm::format(out, "        <maxOutValue>%.9g</maxOutValue>\n", maxOut);
+            tfm::format(out, "    </Range>\n");
+        };
+
+        tfm::format(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+        tfm::format(out, "<ProcessList compCLFversion=\"3.0\" id=\"tonemapper\" name=\"%s\">\n", escapeXml(op.name));
+        tfm::format(out, "    <Description>%s, exposure = %f</Description>\n", escapeXml(op.name), exposure);
+        if (logarithmic) {
+            // Clamp to the minimum, then map [log2(minimum), log2(maximum)] to [0, 1]
+            range(shaper.minimum, shaper.minimum, shaper.minimum, shaper.minimum);
+            tfm::format(out, "    <Log %s style=\"log2\"/>\n", bitDepths);
+            range(std::log2(shaper.minimum), std::log2(shaper.maximum), 0.f, 1.f);
+        } else {
+            range(0.f, shaper.maximum, 0.f, 1.f);
+        }
+        if (separable) {
+            tfm::format(out, "    <LUT1D %s interpolation=\"linear\">\n", bitDepths);
+            tfm::format(out, "        <Array dim=\"%d 3\">\n", size);
+            for (const Color3f &c : entries) {
+                tfm::format(out, "%.9g %.9g %.9g\n", c[0], c[1], c[2]);
+            }
+            tfm::format(out, "        </Array>\n");
+            tfm::format(out, "    </LUT1D>\n");
+        } else {
+            // Blue changes fastest in CLF files
+            tfm::format(out, "    <LUT3D %s interpolation=\"trilinear\">\n", bitDepths);
+            tfm::format(out, "        <Array dim=\"%d %d %d 3\">\n", size, size, size);
+            for (size_t r = 0; r < size; ++r) {
+                for (size_t g = 0; g < size; ++g) {
+                    for (size_t b = 0; b < size; ++b) {
+                        const Color3f &c = entries[(b * size + g) * size + r];
+                        tfm::format(out, "%.9g %.9g %.9g\n", c[0], c[1], c[2]);
+                    }
+                }
+            }
+            tfm::format(out, "        </Array>\n");
+            tfm::format(out, "    </LUT3D>\n");
+        }
+        tfm::format(out, "</ProcessList>\n");
+    }
+
+    std::ofstream file(filename);
+    file << out.str();
+    if (!file) {
+        ERROR("exportLut(): Could not write \"%s\".", filename);
+    }
+    return maxError;
+}
+
+} // Namespace tonemapper
@@ -0,0 +1,169 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <Global.h>
+#include <Tonemap.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace tonemapper {
+
+/* Maps values in [0, range] to a position in [0, size - 1] within a table of
+   `size` entries. Entry 0 holds the value 0 and the remaining ones are spaced
+   logarithmically from `range * 2^-octaves` up to `range`, by interpolating
+   the bit patterns of the floats (which are piecewise linear in log2) so that
+   no logarithm is needed per lookup. Values below the logarithmic part are
+   interpolated linearly towards 0, and values outside of [0, range] (or NaN)
+   are clamped. */
+class LutShaper {
+public:
+    LutShaper() = default;
+    LutShaper(float range, float octaves, size_t size);
+
+    inline float position(float x) const {
+        x = x > 0.f ? std::min(x, m_range) : 0.f;
+        if (x < m_minimum) {
+            return x * m_invMinimum;
+        }
+        int32_t bits;
+        memcpy(&bits, &x, 4);
+        return 1.f + float(bits - m_minimumBits) * m_scale;
+    }
+
+#if defined(TONEMAPPER_SIMD_ENABLED)
+    template <typename F, typename = simd::Mask<F>>
+    TONEMAPPER_SIMD_INLINE F position(F x) const {
+        typedef simd::Mask<F> I;
+        x = simd::select(x > 0.f, simd::min(x, F{} + m_range), F{});
+        F logarithmic = 1.f + __builtin_convertvector((I) x - m_minimumBits, F) * m_scale;
+        return simd::select(x < m_minimum, x * m_invMinimum, logarithmic);
+    }
+#endif
+
+    // Input value at a (fractional) position, the inverse of `position`
+    float value(float position) const;
+
+    inline float getRange() const { return m_range; }
+    inline size_t getSize() const { return m_size; }
+
+private:
+    float m_range = 1.f, m_minimum = 1.f, m_invMinimum = 1.f, m_scale = 0.f;
+    int32_t m_minimumBits = 0;
+    size_t m_size = 2;
+};
+
+/* Lookup table version of another operator, for exposed input values (i.e.
+   `exposure` times the input color) in [0, range]. The table is only valid for
+   this exposure, as operators may also scale their parameters by it. The
+   layout of the table follows the traits the operator declares:
+   - Separable operators are baked into one 1D curve per channel.
+   - Luminance-scaled operators are baked into a 1D curve of the ratio of the
+     tonemapped and original luminance, which scales the color, and a 1D
+     display curve that is applied to each channel.
+   - All others are baked into a 3D table that is interpolated trilinearly.
+   All tables are indexed through a `LutShaper`. Curves of monotonic operators
+   only extend up to where they saturate at their maximum output. The operator
+   must already be set up for the image (see `TonemapOperator::preprocess`),
+   and the table stays valid as long as its parameters do not change.
+   Baking measures the largest deviation from the exact operator between the
+   table entries, where the interpolation error is largest. */
+class BakedOperator : public TonemapOperator {
+public:
+    enum class Layout {
+        Curves,
+        Luminance,
+        Cube
+    };
+
+    /* `curveSize` is the number of entries of the 1D curves and `cubeSize` the
+       number of entries along each axis of the 3D table. */
+    BakedOperator(const TonemapOperator &op, float exposure, float range, size_t curveSize=4096, size_t cubeSize=65);
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override;
+
+    inline Layout getLayout() const { return m_layout; }
+
+    /* True if the 1D curves reach the maximum output of the operator within
+       the range, so that clamping larger inputs to it is exact */
+    inline bool isSaturated() const { return m_saturated; }
+
+    // Largest absolute error of any channel, measured while baking
+    inline float getMaxError() const { return m_maxError; }
+
+    /* Shaper of the 1D curves (for the `Luminance` layout the one of the
+       luminance ratio) or of the 3D table */
+    inline const LutShaper &getShaper() const { return m_shaper; }
+
+    // Shaper of the display curve of the `Luminance` layout
+    inline const LutShaper &getDisplayShaper() const { return m_displayShaper; }
+
+    /* Entry `k` of the curve of channel `ch`. For the `Luminance` layout,
+       curve 0 is the luminance ratio and curve 1 the display curve. */
+    inline float curve(size_t ch, size_t k) const { return m_curves[ch][2 * k]; }
+
+    // Entry (r, g, b) of the 3D table
+    inline const Color3f &cube(size_t r, size_t g, size_t b) const {
+        size_t size = m_shaper.getSize();
+        return m_cube[(b * size + g) * size + r];
+    }
+
+    // Interpolated output for one exposed input color
+    Color3f lookup(const Color3f &c) const;
+
+private:
+    // Shared by `lookup` and the vectorized versions in `mapSpan`
+    template <typename Color>
+    Color interpolateColor(const Color &c) const;
+
+    Layout m_layout;
+    LutShaper m_shaper, m_displayShaper;
+    std::vector<float> m_curves[3];     // Entries and differences to the next ones
+    std::vector<Color3f> m_cube;
+    float m_maxError = 0.f;
+    bool m_saturated = false;
+};
+
+// Encoding of the input values of exported lookup tables
+enum class LutShaperType {
+    Linear,
+    Log2
+};
+
+struct LutExportOptions {
+    size_t curveSize = 4096;    // Entries of 1D tables (and shapers)
+    size_t cubeSize  = 65;      // Entries along each axis of 3D tables
+
+    /* The tables take input values (before the exposure is applied) up to
+       `maximum`. The linear shaper spaces the entries evenly from 0, the log2
+       shaper spaces them logarithmically from `minimum` (smaller values are
+       clamped to it). A `minimum` of 0 stands for `maximum * 2^-16`. */
+    LutShaperType shaper = LutShaperType::Log2;
+    float minimum = 0.f,
+          maximum = 1.f;
+};
+
+/* Write the operator `op` with the exposure `exposure` into a lookup table
+   file for other applications, in the format given by the extension of
+   `filename`:
+   - ".cube": A 1D table for separable operators, and a 3D table otherwise.
+     With the log2 shaper, 3D tables are preceded by a 1D shaper table (as in
+     the .cube files of DaVinci Resolve).
+   - ".spi1d": A 1D table (OpenColorIO), only for separable operators.
+   - ".clf": A Common LUT Format process list, with the shaper as `Range` and
+     `Log` nodes followed by a 1D or 3D table.
+   1D tables in ".cube" and ".spi1d" files are always spaced linearly, as
+   these formats have no shaper for them. The operator must already be set up
+   (see `TonemapOperator::preprocess`). Returns the largest absolute error of
+   any channel between the table entries. */
+float exportLut(const TonemapOperator &op, float exposure, const std::string &filename,
+                const LutExportOptions &options = LutExportOptions());
+
+} // Namespace tonemapper
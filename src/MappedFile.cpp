@@ -0,0 +1,78 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <MappedFile.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace tonemapper {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &filename, bool copyOnWrite) : m_copyOnWrite(copyOnWrite) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, nullptr, 0);
+    std::wstring wideFilename(size_t(std::max(length, 1)), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, filename.c_str(), -1, &wideFilename[0], length);
+
+    HANDLE file = CreateFileW(wideFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+    m_file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return;
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) return;
+    m_mapping = mapping;
+
+    m_data = (const uint8_t *) MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    if (m_data) {
+        m_size = size_t(size.QuadPart);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle((HANDLE) m_mapping);
+    if (m_file) CloseHandle((HANDLE) m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filename, bool copyOnWrite) : m_copyOnWrite(copyOnWrite) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *data = mmap(nullptr, size_t(info.st_size), protection, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            m_data = (const uint8_t *) data;
+            m_size = size_t(info.st_size);
+        }
+    }
+
+    // The mapping stays valid after the file is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) munmap((void *) m_data, m_size);
+}
+
+#endif
+
+} // Namespace tonemapper
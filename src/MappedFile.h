@@ -0,0 +1,47 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <Global.h>
+
+#include <cstdint>
+
+namespace tonemapper {
+
+/* Read-only memory mapping of a whole file. Pages are only read from disk
+   when they are accessed, so decoders can work directly on the file contents
+   without first copying them into a buffer. */
+class MappedFile {
+public:
+    /* A copy-on-write mapping can also be modified through `getMutableData`,
+       which copies the touched pages but never changes the file. This allows
+       an `Image` to adopt the file contents as its pixels. */
+    MappedFile(const std::string &filename, bool copyOnWrite = false);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // False if the file could not be opened or mapped (e.g. because it is empty)
+    inline bool isValid() const { return m_data != nullptr; }
+
+    inline const uint8_t *getData() const { return m_data; }
+    inline uint8_t *getMutableData() { return m_copyOnWrite ? (uint8_t *) m_data : nullptr; }
+    inline size_t getSize() const { return m_size; }
+
+private:
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_copyOnWrite;
+#ifdef _WIN32
+    void *m_file = nullptr,
+         *m_mapping = nullptr;
+#endif
+};
+
+} // Namespace tonemapper
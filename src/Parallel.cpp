@@ -0,0 +1,222 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace tonemapper {
+
+/* Bookkeeping for one `parallelFor` call. Each slot holds a range of task
+   indices [begin, end) packed into a single 64 bit word so that the owner
+   (taking tasks from the front) and thieves (taking tasks from the back) can
+   both update it with a single compare-and-swap. */
+struct ThreadPool::Group {
+    const std::function<void (size_t)> *func = nullptr;
+    bool deterministic = false;
+
+    size_t slotCount = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> ranges;
+    std::atomic<size_t> nextSlot{0};
+
+    // Number of pool workers currently inside `runGroup`, guarded by the pool mutex
+    size_t participants = 0;
+
+    std::mutex exceptionMutex;
+    std::exception_ptr exception;
+};
+
+namespace {
+
+inline uint64_t packRange(uint32_t begin, uint32_t end) {
+    return (uint64_t(begin) << 32) | uint64_t(end);
+}
+
+inline uint32_t rangeBegin(uint64_t range) { return uint32_t(range >> 32); }
+inline uint32_t rangeEnd(uint64_t range)   { return uint32_t(range); }
+
+} // Anonymous namespace
+
+ThreadPool::ThreadPool() {
+    startWorkers(0);
+}
+
+ThreadPool::~ThreadPool() {
+    stopWorkers();
+}
+
+ThreadPool &ThreadPool::get() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::setThreadCount(size_t count) {
+    stopWorkers();
+    startWorkers(count);
+}
+
+void ThreadPool::startWorkers(size_t count) {
+    if (count == 0) {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_shutdown = false;
+    for (size_t i = 0; i + 1 < count; ++i) {
+        m_workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+void ThreadPool::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_workAvailable.notify_all();
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+void ThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        // Join any group that still has a range nobody claimed yet
+        Group *group = nullptr;
+        m_workAvailable.wait(lock, [&] {
+            if (m_shutdown) return true;
+            for (Group *g : m_groups) {
+                if (g->nextSlot.load() < g->slotCount) {
+                    group = g;
+                    return true;
+                }
+            }
+            return false;
+        });
+        if (m_shutdown) return;
+
+        group->participants++;
+        lock.unlock();
+        runGroup(*group);
+        lock.lock();
+        if (--group->participants == 0) {
+            m_groupFinished.notify_all();
+        }
+    }
+}
+
+void ThreadPool::runGroup(Group &group) {
+    auto run = [&](size_t i) {
+        try {
+            (*group.func)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(group.exceptionMutex);
+            if (!group.exception) {
+                group.exception = std::current_exception();
+            }
+        }
+    };
+
+    auto drain = [&](size_t slot) {
+        std::atomic<uint64_t> &range = group.ranges[slot];
+        uint64_t r = range.load();
+        while (rangeBegin(r) < rangeEnd(r)) {
+            if (range.compare_exchange_weak(r, packRange(rangeBegin(r) + 1, rangeEnd(r)))) {
+                run(rangeBegin(r));
+                r = range.load();
+            }
+        }
+    };
+
+    size_t home = group.nextSlot++;
+    if (home >= group.slotCount) {
+        return;
+    }
+    drain(home);
+
+    // Take over the ranges of threads that did not (yet) join
+    for (size_t slot = group.nextSlot++; slot < group.slotCount; slot = group.nextSlot++) {
+        drain(slot);
+    }
+
+    if (group.deterministic) {
+        return;
+    }
+
+    // Steal the back half of the fullest remaining range into our own slot
+    while (true) {
+        size_t victim = group.slotCount;
+        uint64_t victimRange = 0;
+        uint32_t mostRemaining = 0;
+        for (size_t slot = 0; slot < group.slotCount; ++slot) {
+            uint64_t r = group.ranges[slot].load();
+            if (rangeBegin(r) < rangeEnd(r) && rangeEnd(r) - rangeBegin(r) > mostRemaining) {
+                mostRemaining = rangeEnd(r) - rangeBegin(r);
+                victimRange = r;
+                victim = slot;
+            }
+        }
+        if (victim == group.slotCount) {
+            break;
+        }
+
+        uint32_t begin = rangeBegin(victimRange),
+                 end   = rangeEnd(victimRange),
+                 mid   = end - std::max(1u, (end - begin) / 2);
+        if (group.ranges[victim].compare_exchange_strong(victimRange, packRange(begin, mid))) {
+            group.ranges[home].store(packRange(mid, end));
+            drain(home);
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void (size_t)> &func) {
+    if (count == 0) {
+        return;
+    }
+    if (m_workers.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+    if (count > size_t(std::numeric_limits<uint32_t>::max())) {
+        ERROR("ThreadPool::parallelFor(): too many tasks (%d).", count);
+    }
+
+    Group group;
+    group.func = &func;
+    group.deterministic = m_deterministic;
+    group.slotCount = std::min(count, getThreadCount());
+    group.ranges.reset(new std::atomic<uint64_t>[group.slotCount]);
+    for (size_t slot = 0; slot < group.slotCount; ++slot) {
+        uint32_t begin = uint32_t(count * slot / group.slotCount),
+                 end   = uint32_t(count * (slot + 1) / group.slotCount);
+        group.ranges[slot].store(packRange(begin, end));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_groups.push_back(&group);
+    }
+    m_workAvailable.notify_all();
+
+    // The calling thread participates as well
+    runGroup(group);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_groupFinished.wait(lock, [&] { return group.participants == 0; });
+        m_groups.erase(std::find(m_groups.begin(), m_groups.end(), &group));
+    }
+
+    if (group.exception) {
+        std::rethrow_exception(group.exception);
+    }
+}
+
+} // Namespace tonemapper
@@ -0,0 +1,68 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <Global.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace tonemapper {
+
+/* Small work-stealing thread pool. Each call to `parallelFor` splits its tasks
+   into contiguous ranges, one per participating thread. Threads first drain
+   their own range and afterwards steal half of the remaining work of the
+   busiest range. Several threads may call `parallelFor` concurrently, idle
+   workers then help out with whichever call still has work left. */
+class ThreadPool {
+public:
+    ~ThreadPool();
+
+    // Global pool that is shared by all processing code
+    static ThreadPool &get();
+
+    // Total number of threads used by `parallelFor`, including the calling thread
+    size_t getThreadCount() const { return m_workers.size() + 1; }
+
+    /* Change the number of threads, 0 means one per hardware thread. Must not
+       be called while any `parallelFor` is running. */
+    void setThreadCount(size_t count);
+
+    /* When enabled, work stealing is disabled and each range of tasks is
+       processed in order by a single thread. */
+    bool isDeterministic() const { return m_deterministic; }
+    void setDeterministic(bool deterministic) { m_deterministic = deterministic; }
+
+    // Call `func(i)` for all i in [0, count) and block until all calls are done
+    void parallelFor(size_t count, const std::function<void (size_t)> &func);
+
+private:
+    struct Group;
+
+    ThreadPool();
+
+    void startWorkers(size_t count);
+    void stopWorkers();
+    void workerLoop();
+    static void runGroup(Group &group);
+
+private:
+    std::vector<std::thread> m_workers;
+    std::deque<Group *> m_groups;
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable,
+                            m_groupFinished;
+    bool m_shutdown = false;
+    bool m_deterministic = false;
+};
+
+} // Namespace tonemapper
@@ -0,0 +1,176 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <Pipeline.h>
+
+#include <Image.h>
+#include <Tonemap.h>
+
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace tonemapper {
+
+namespace {
+
+void tonemapToFile(const TonemapOperator &tm, const Image &input, Image *inPlace, float exposure,
+                   const std::string &filename, const SaveOptions &options,
+                   std::atomic<float> *progress) {
+    size_t width  = input.getWidth(),
+           height = input.getHeight();
+
+    int bitDepth = Image::getBitDepth(filename, options);
+    if (bitDepth == 0) {
+        // Floating point files keep the values outside of [0, 1]
+        if (inPlace && inPlace->getLayout() != PixelLayout::PlanarHalf) {
+            tm.process(inPlace, exposure, progress);
+            inPlace->save(filename, options);
+        } else {
+            Image output(width, height, PixelLayout::Planar);
+            tm.process(&input, &output, exposure, progress);
+            output.save(filename, options);
+        }
+    } else if (bitDepth == 16) {
+        std::unique_ptr<uint16_t[]> rgb16(new uint16_t[3 * width * height]);
+        tm.processToLDR(&input, (uint8_t *) rgb16.get(), 6 * width, exposure, 16, options.dither, progress);
+        Image::saveLDR(filename, rgb16.get(), width, height, options);
+    } else {
+        std::unique_ptr<uint8_t[]> rgb8(new uint8_t[3 * width * height]);
+        tm.processToLDR(&input, rgb8.get(), 3 * width, exposure, 8, options.dither, progress);
+        Image::saveLDR(filename, rgb8.get(), width, height, options);
+    }
+}
+
+} // Anonymous namespace
+
+void tonemapToFile(const TonemapOperator &tm, const Image &input, float exposure,
+                   const std::string &filename, const SaveOptions &options,
+                   std::atomic<float> *progress) {
+    tonemapToFile(tm, input, nullptr, exposure, filename, options, progress);
+}
+
+void tonemapToFile(const TonemapOperator &tm, Image *input, float exposure,
+                   const std::string &filename, const SaveOptions &options,
+                   std::atomic<float> *progress) {
+    tonemapToFile(tm, *input, input, exposure, filename, options, progress);
+}
+
+size_t estimateTonemapMemory(const std::string &filename, const LoadOptions &options,
+                             const std::string &outputFilename, const SaveOptions &saveOptions) {
+    size_t width, height;
+    if (!Image::readSize(filename, width, height)) {
+        return 0;
+    }
+
+    // Only the (downsampled) region of interest is kept
+    if (options.roiX < width && options.roiY < height) {
+        width  = options.roiWidth  > 0 ? std::min(options.roiWidth,  width  - options.roiX) : width  - options.roiX;
+        height = options.roiHeight > 0 ? std::min(options.roiHeight, height - options.roiY) : height - options.roiY;
+    }
+    size_t factor = std::max(options.downsample, size_t(1));
+    width  = (width  + factor - 1) / factor;
+    height = (height + factor - 1) / factor;
+
+    /* The decoder output, the image it is converted into, and the output:
+       quantized samples for the encoder, or for floating point formats a
+       second image if the input cannot be overwritten. Encoders then hold
+       the file contents (up to the size of the samples). */
+    bool half = options.layout == PixelLayout::PlanarHalf;
+    size_t imageSize = half ? 3 * sizeof(uint16_t) : sizeof(Color3f),
+           outputSize, fileSize;
+    int bitDepth = Image::getBitDepth(outputFilename, saveOptions);
+    if (bitDepth == 0) {
+        std::string format = saveOptions.format.empty() ? std::filesystem::path(outputFilename).extension().string()
+                                                        : saveOptions.format;
+        bool halfFile = (format == ".exr" && saveOptions.exrHalf) || (format == ".raw" && saveOptions.rawHalf);
+        outputSize = half ? sizeof(Color3f) : 0;
+        fileSize   = halfFile ? 3 * sizeof(uint16_t) : sizeof(Color3f);
+    } else {
+        outputSize = fileSize = 3 * size_t(bitDepth / 8);
+    }
+    return width * height * (sizeof(Color3f) + imageSize + outputSize + fileSize);
+}
+
+BatchScheduler::BatchScheduler(size_t jobs, size_t memoryBudget)
+    : m_jobs(jobs), m_memoryBudget(memoryBudget) {
+    if (m_jobs == 0) {
+        m_jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+size_t BatchScheduler::run(size_t count, const Estimator &estimate, const Job &job) const {
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t next     = 0,    // Next item to start
+           printed  = 0,    // Number of items whose output was printed
+           running  = 0,
+           reserved = 0,    // Sum of the memory estimates of the running items
+           failed   = 0;
+    std::vector<std::string> output(count);
+    std::vector<bool> done(count, false);
+
+    auto worker = [&]() {
+        while (true) {
+            size_t i;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (next >= count) return;
+                i = next++;
+            }
+
+            size_t memory = estimate(i);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() {
+                    return running == 0 || m_memoryBudget == 0 || reserved + memory <= m_memoryBudget;
+                });
+                running++;
+                reserved += memory;
+            }
+
+            std::ostringstream log;
+            bool success = true;
+            try {
+                job(i, log);
+            } catch (const std::exception &e) {
+                log << e.what() << std::endl;
+                success = false;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+            reserved -= memory;
+            if (!success) failed++;
+            output[i] = log.str();
+            done[i] = true;
+            while (printed < count && done[printed]) {
+                std::cout << output[printed] << std::flush;
+                output[printed].clear();
+                printed++;
+            }
+            changed.notify_all();
+        }
+    };
+
+    size_t threadCount = std::min(m_jobs, count);
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < threadCount; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    return failed;
+}
+
+} // Namespace tonemapper
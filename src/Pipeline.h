@@ -0,0 +1,72 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <Global.h>
+
+#include <atomic>
+#include <functional>
+#include <ostream>
+
+namespace tonemapper {
+
+class Image;
+class TonemapOperator;
+struct LoadOptions;
+struct SaveOptions;
+
+/* Tonemap `input` and write the result to `filename`, in any format supported
+   by `Image::save`. Quantized formats are written without allocating a float
+   output image, see `TonemapOperator::processToLDR`. */
+void tonemapToFile(const TonemapOperator &tm, const Image &input, float exposure,
+                   const std::string &filename, const SaveOptions &options,
+                   std::atomic<float> *progress=nullptr);
+
+/* Version for input images that are not needed afterwards: floating point
+   formats are tonemapped in place instead of into a second image (unless
+   `input` only holds half floats). */
+void tonemapToFile(const TonemapOperator &tm, Image *input, float exposure,
+                   const std::string &filename, const SaveOptions &options,
+                   std::atomic<float> *progress=nullptr);
+
+/* Estimate of the peak memory (in bytes) needed to load the image `filename`
+   (or the part of it selected by `options`) and to tonemap it into the file
+   `outputFilename` with the in-place version of `tonemapToFile`, based on its
+   header. Returns 0 if the header cannot be read. */
+size_t estimateTonemapMemory(const std::string &filename, const LoadOptions &options,
+                             const std::string &outputFilename, const SaveOptions &saveOptions);
+
+/* Runs a batch of independent items (e.g. one per input image) with several
+   items in flight at once, so that the decoding, tonemapping and encoding
+   stages of different items overlap. Items are started in order, and each
+   one writes its console output into a buffer that is printed once all
+   previous items are done, so the output reads the same as a sequential run.
+   The tonemapping of each item still goes through the global `ThreadPool`,
+   which is shared by all items. */
+class BatchScheduler {
+public:
+    /* `jobs` is the maximum number of items in flight (0 means one per hardware
+       thread) and `memoryBudget` the maximum sum (in bytes, 0 for unlimited)
+       of the memory estimates of the running items. An item whose estimate
+       alone exceeds the budget still runs, but only on its own. */
+    BatchScheduler(size_t jobs, size_t memoryBudget);
+
+    typedef std::function<size_t (size_t)> Estimator;
+    typedef std::function<void (size_t, std::ostream &)> Job;
+
+    /* Call `job(i, log)` for all i in [0, count), where `estimate(i)` gives the
+       memory needed by item i. Exceptions thrown by a job are printed as part
+       of its output. Returns the number of items that failed. */
+    size_t run(size_t count, const Estimator &estimate, const Job &job) const;
+
+private:
+    size_t m_jobs;
+    size_t m_memoryBudget;
+};
+
+} // Namespace tonemapper
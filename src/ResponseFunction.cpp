@@ -0,0 +1,205 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <ResponseFunction.h>
+
+#include <MappedFile.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace tonemapper {
+
+namespace {
+
+constexpr char     PackMagic[4]  = { 'T', 'M', 'R', 'F' };
+constexpr uint32_t PackVersion   = 1;
+constexpr size_t   HeaderSize    = 16;
+constexpr size_t   IndexEntrySize = 24;
+
+inline uint32_t get32(const uint8_t *p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+inline uint64_t get64(const uint8_t *p) {
+    return uint64_t(get32(p)) | (uint64_t(get32(p + 4)) << 32);
+}
+
+inline void put32(std::vector<uint8_t> &out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(uint8_t(value >> (8 * i)));
+    }
+}
+
+inline void put64(std::vector<uint8_t> &out, uint64_t value) {
+    put32(out, uint32_t(value));
+    put32(out, uint32_t(value >> 32));
+}
+
+} // Anonymous namespace
+
+bool readResponseFunction(const std::string &filename, ResponseFunction &rf) {
+    rf.irradiance.clear();
+    for (size_t ch = 0; ch < 3; ++ch) {
+        rf.values[ch].clear();
+    }
+
+    std::ifstream is(filename);
+    if (is.bad() || is.fail()) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(is, line)) {
+        if (line.length() == 0 || line[0] == '#') {
+            continue;
+        }
+        std::istringstream iss(line);
+
+        float irr, r, g, b;
+        if (!(iss >> irr >> r >> g >> b)) {
+            break;
+        }
+        rf.irradiance.push_back(irr);
+        rf.values[0].push_back(r);
+        rf.values[1].push_back(g);
+        rf.values[2].push_back(b);
+    }
+    return true;
+}
+
+ResponseFunctionPack::ResponseFunctionPack(const std::string &filename)
+    : m_file(new MappedFile(filename)) {
+    if (!m_file->isValid() || m_file->getSize() < HeaderSize) return;
+
+    const uint8_t *data = m_file->getData();
+    size_t size = m_file->getSize();
+    if (memcmp(data, PackMagic, 4) != 0 || get32(data + 4) != PackVersion) return;
+
+    // Check all entries once, so that lookups can trust the index
+    size_t count = get32(data + 8);
+    if (count > (size - HeaderSize) / IndexEntrySize) return;
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t *entry = data + HeaderSize + i * IndexEntrySize;
+        uint64_t nameOffset  = get32(entry),
+                 nameLength  = get32(entry + 4),
+                 samples     = get32(entry + 8),
+                 dataOffset  = get64(entry + 16);
+        if (nameOffset + nameLength > size || dataOffset % 4 != 0 ||
+            dataOffset > size || 16 * samples > size - dataOffset) return;
+    }
+    m_count = count;
+}
+
+ResponseFunctionPack::~ResponseFunctionPack() {}
+
+std::string ResponseFunctionPack::getName(size_t i) const {
+    const uint8_t *entry = m_file->getData() + HeaderSize + i * IndexEntrySize;
+    return std::string((const char *) m_file->getData() + get32(entry), get32(entry + 4));
+}
+
+bool ResponseFunctionPack::find(const std::string &name, ResponseFunction &rf) const {
+    // The index is sorted by name
+    size_t first = 0,
+           last  = m_count;
+    while (first < last) {
+        size_t middle = (first + last) / 2;
+        int order = getName(middle).compare(name);
+        if (order == 0) {
+            read(middle, rf);
+            return true;
+        }
+        if (order < 0) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    return false;
+}
+
+void ResponseFunctionPack::read(size_t i, ResponseFunction &rf) const {
+    const uint8_t *entry = m_file->getData() + HeaderSize + i * IndexEntrySize;
+    size_t samples = get32(entry + 8);
+    const uint8_t *curves = m_file->getData() + get64(entry + 16);
+
+    auto readCurve = [&](size_t k, std::vector<float> &curve) {
+        curve.resize(samples);
+        for (size_t j = 0; j < samples; ++j) {
+            uint32_t bits = get32(curves + 4 * (k * samples + j));
+            memcpy(&curve[j], &bits, 4);
+        }
+    };
+    rf.name = getName(i);
+    readCurve(0, rf.irradiance);
+    for (size_t ch = 0; ch < 3; ++ch) {
+        readCurve(ch + 1, rf.values[ch]);
+    }
+}
+
+void ResponseFunctionPack::write(const std::string &filename, std::vector<ResponseFunction> functions) {
+    std::sort(functions.begin(), functions.end(), [](const ResponseFunction &a, const ResponseFunction &b) {
+        return a.name < b.name;
+    });
+    for (size_t i = 0; i + 1 < functions.size(); ++i) {
+        if (functions[i].name == functions[i + 1].name) {
+            ERROR("ResponseFunctionPack::write(): Duplicate response function \"%s\".", functions[i].name);
+        }
+    }
+
+    // Names follow the index, the curves start at the next multiple of 4 bytes
+    std::vector<uint8_t> names;
+    for (const ResponseFunction &rf : functions) {
+        names.insert(names.end(), rf.name.begin(), rf.name.end());
+    }
+    while (names.size() % 4 != 0) {
+        names.push_back(0);
+    }
+
+    std::vector<uint8_t> out;
+    out.insert(out.end(), PackMagic, PackMagic + 4);
+    put32(out, PackVersion);
+    put32(out, uint32_t(functions.size()));
+    put32(out, 0);
+
+    size_t nameOffset = HeaderSize + functions.size() * IndexEntrySize,
+           dataOffset = nameOffset + names.size();
+    for (const ResponseFunction &rf : functions) {
+        size_t samples = rf.irradiance.size();
+        put32(out, uint32_t(nameOffset));
+        put32(out, uint32_t(rf.name.size()));
+        put32(out, uint32_t(samples));
+        put32(out, 0);
+        put64(out, dataOffset);
+        nameOffset += rf.name.size();
+        dataOffset += 16 * samples;
+    }
+    out.insert(out.end(), names.begin(), names.end());
+
+    for (const ResponseFunction &rf : functions) {
+        for (const std::vector<float> *curve : { &rf.irradiance, &rf.values[0], &rf.values[1], &rf.values[2] }) {
+            if (curve->size() != rf.irradiance.size()) {
+                ERROR("ResponseFunctionPack::write(): Curves of response function \"%s\" differ in length.", rf.name);
+            }
+            for (float value : *curve) {
+                uint32_t bits;
+                memcpy(&bits, &value, 4);
+                put32(out, bits);
+            }
+        }
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write((const char *) out.data(), std::streamsize(out.size()));
+    if (!file) {
+        ERROR("ResponseFunctionPack::write(): Could not write \"%s\".", filename);
+    }
+}
+
+} // Namespace tonemapper
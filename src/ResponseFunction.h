@@ -0,0 +1,63 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <Global.h>
+
+#include <memory>
+
+namespace tonemapper {
+
+class MappedFile;
+
+// Camera response curves, sampled at increasing irradiance values
+struct ResponseFunction {
+    std::string name;
+    std::vector<float> irradiance;
+    std::vector<float> values[3];
+};
+
+/* Read a text file with one "irradiance r g b" row per sample, such as the
+   ".rf" files of the DoRF database. Lines starting with '#' are skipped.
+   Returns false if the file could not be opened. */
+bool readResponseFunction(const std::string &filename, ResponseFunction &rf);
+
+/* Binary pack of many response functions in a single file, which is memory
+   mapped so that loading one of them needs no parsing. The file consists of
+   (all numbers little-endian)
+   - a header: the magic "TMRF", the version and the number of entries,
+   - an index with one entry per response function, sorted by name: offset
+     and length of the name, number of samples, and offset of the curves,
+   - the names, and
+   - the curves of each response function: the irradiance values followed
+     by the red, green, and blue values, as 32-bit floats. */
+class ResponseFunctionPack {
+public:
+    ResponseFunctionPack(const std::string &filename);
+    ~ResponseFunctionPack();
+
+    // False if the file could not be opened or is no valid pack
+    inline bool isValid() const { return m_count > 0; }
+
+    inline size_t getSize() const { return m_count; }
+    std::string getName(size_t i) const;
+
+    // Copy the curves of the entry called `name`, returns false if there is none
+    bool find(const std::string &name, ResponseFunction &rf) const;
+
+    // Write all of `functions` (with unique names) into a pack
+    static void write(const std::string &filename, std::vector<ResponseFunction> functions);
+
+private:
+    void read(size_t i, ResponseFunction &rf) const;
+
+    std::unique_ptr<MappedFile> m_file;
+    size_t m_count = 0;
+};
+
+} // Namespace tonemapper
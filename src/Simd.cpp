@@ -0,0 +1,114 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <Simd.h>
+
+#include <atomic>
+
+#if defined(TONEMAPPER_SIMD_X86)
+    #include <immintrin.h>
+#endif
+
+namespace tonemapper {
+
+namespace {
+
+// Active level, -1 until it was either set or detected
+std::atomic<int> g_simdLevel{-1};
+
+} // Anonymous namespace
+
+bool isSimdLevelSupported(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Off:
+        return true;
+#if defined(TONEMAPPER_SIMD_X86)
+    case SimdLevel::SSE:
+        return true;
+    case SimdLevel::AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case SimdLevel::AVX512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(TONEMAPPER_SIMD_NEON)
+    case SimdLevel::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+SimdLevel detectSimdLevel() {
+    SimdLevel levels[] = { SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE, SimdLevel::NEON };
+    for (SimdLevel level : levels) {
+        if (isSimdLevelSupported(level)) {
+            return level;
+        }
+    }
+    return SimdLevel::Off;
+}
+
+SimdLevel getSimdLevel() {
+    int level = g_simdLevel.load(std::memory_order_relaxed);
+    if (level < 0) {
+        level = int(detectSimdLevel());
+        g_simdLevel.store(level, std::memory_order_relaxed);
+    }
+    return SimdLevel(level);
+}
+
+void setSimdLevel(SimdLevel level) {
+    if (!isSimdLevelSupported(level)) {
+        ERROR("setSimdLevel(): \"%s\" is not supported on this system.", simdLevelName(level));
+    }
+    g_simdLevel.store(int(level), std::memory_order_relaxed);
+}
+
+const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Off:    return "off";
+    case SimdLevel::SSE:    return "sse";
+    case SimdLevel::AVX2:   return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    case SimdLevel::NEON:   return "neon";
+    }
+    return "unknown";
+}
+
+bool parseSimdLevel(const std::string &name, SimdLevel &level) {
+    SimdLevel levels[] = { SimdLevel::Off, SimdLevel::SSE, SimdLevel::AVX2, SimdLevel::AVX512, SimdLevel::NEON };
+    for (SimdLevel l : levels) {
+        if (name == simdLevelName(l)) {
+            level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+#if defined(TONEMAPPER_SIMD_X86)
+namespace simd {
+
+__attribute__((target("avx2")))
+void gatherAVX2(const float *table, const int32_t *indices, float *values) {
+    __m256i index = _mm256_loadu_si256((const __m256i *) indices);
+    _mm256_storeu_ps(values, _mm256_i32gather_ps(table, index, 4));
+}
+
+__attribute__((target("avx512f")))
+void gatherAVX512(const float *table, const int32_t *indices, float *values) {
+    __m512i index = _mm512_loadu_si512(indices);
+    // The masked form, as GCC warns about the undefined source of the plain one
+    _mm512_storeu_ps(values, _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, index, table, 4));
+}
+
+} // Namespace simd
+#endif
+
+} // Namespace tonemapper
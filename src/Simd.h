@@ -0,0 +1,512 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <Global.h>
+#include <Color.h>
+#include <Image.h>
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/* Vectorized operator kernels are built on the GCC/Clang vector extensions,
+   which map to SSE/AVX2/AVX-512 on x86 and NEON on ARM. Wider instruction
+   sets are enabled per function via target attributes and picked at runtime,
+   so the binary still runs on CPUs without them. Other compilers only get the
+   scalar code path. */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+    #define TONEMAPPER_SIMD_X86
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__ARM_NEON)
+    #define TONEMAPPER_SIMD_NEON
+#endif
+
+#if defined(TONEMAPPER_SIMD_X86) || defined(TONEMAPPER_SIMD_NEON)
+    #define TONEMAPPER_SIMD_ENABLED
+    // All vector helpers are force-inlined, so the vector ABI of the default target never matters
+    #pragma GCC diagnostic ignored "-Wpsabi"
+    #define TONEMAPPER_SIMD_INLINE inline __attribute__((always_inline))
+    // Marks an operator kernel lambda, see `simd::mapPixels`
+    #define TONEMAPPER_SIMD_KERNEL __attribute__((always_inline))
+#else
+    #define TONEMAPPER_SIMD_INLINE inline
+    #define TONEMAPPER_SIMD_KERNEL
+#endif
+
+namespace tonemapper {
+
+enum class SimdLevel {
+    Off = 0,    // Exact scalar code path
+    SSE,        // 4 pixels at once
+    AVX2,       // 8 pixels at once
+    AVX512,     // 16 pixels at once
+    NEON        // 4 pixels at once
+};
+
+// Best instruction set supported by both the build and the CPU
+SimdLevel detectSimdLevel();
+
+bool isSimdLevelSupported(SimdLevel level);
+
+// Instruction set used by all operators, defaults to `detectSimdLevel()`
+SimdLevel getSimdLevel();
+void setSimdLevel(SimdLevel level);
+
+const char *simdLevelName(SimdLevel level);
+bool parseSimdLevel(const std::string &name, SimdLevel &level);
+
+namespace simd {
+
+/* Scalar versions of the math functions below. Kernels call these through
+   the `simd::` prefix so that the same code compiles for single pixels (with
+   the exact standard library functions) and for vectors of pixels. Like the
+   vectorized version, `pow` returns zero for all bases that are not positive. */
+inline float exp(float x)                       { return std::exp(x); }
+inline float log(float x)                       { return std::log(x); }
+inline float log10(float x)                     { return std::log10(x); }
+inline float pow(float x, float y)              { return x > 0.f ? std::pow(x, y) : 0.f; }
+inline float min(float a, float b)              { return std::min(a, b); }
+inline float max(float a, float b)              { return std::max(a, b); }
+inline float clamp(float v, float lo, float hi) { return std::clamp(v, lo, hi); }
+inline float select(bool mask, float a, float b) { return mask ? a : b; }
+
+/* Linear interpolation in a table of `size` entries that each hold a value
+   followed by the difference to the next one, at a (fractional) position in
+   [0, size - 1]. */
+inline float interpolate(const float *curve, size_t size, float position) {
+    int32_t k = std::min(int32_t(position), int32_t(size - 2));
+    return curve[2 * k] + (position - float(k)) * curve[2 * k + 1];
+}
+
+#if defined(TONEMAPPER_SIMD_ENABLED)
+
+typedef float   Float4  __attribute__((vector_size(16)));
+typedef int32_t Int4    __attribute__((vector_size(16)));
+typedef float   Float8  __attribute__((vector_size(32)));
+typedef int32_t Int8    __attribute__((vector_size(32)));
+typedef float   Float16 __attribute__((vector_size(64)));
+typedef int32_t Int16   __attribute__((vector_size(64)));
+
+// Integer vector with the same width, also the result type of comparisons
+template <typename F> struct IntVector;
+template <> struct IntVector<Float4>  { typedef Int4  Type; };
+template <> struct IntVector<Float8>  { typedef Int8  Type; };
+template <> struct IntVector<Float16> { typedef Int16 Type; };
+
+template <typename F>
+using Mask = typename IntVector<F>::Type;
+
+template <typename F>
+TONEMAPPER_SIMD_INLINE F select(Mask<F> mask, F a, F b) {
+    typedef Mask<F> I;
+    return (F) (((I) a & mask) | ((I) b & ~mask));
+}
+
+template <typename F>
+TONEMAPPER_SIMD_INLINE F select(Mask<F> mask, F a, float b) {
+    return select(mask, a, F{} + b);
+}
+
+template <typename F>
+TONEMAPPER_SIMD_INLINE F select(Mask<F> mask, float a, F b) {
+    return select(mask, F{} + a, b);
+}
+
+// Same semantics as `std::min`, `std::max`, and `std::clamp` (also for NaNs)
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F min(F a, F b) {
+    return select(b < a, b, a);
+}
+
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F max(F a, F b) {
+    return select(a < b, b, a);
+}
+
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F clamp(F v, float lo, float hi) {
+    return select(v < lo, F{} + lo, select(hi < v, F{} + hi, v));
+}
+
+#if defined(TONEMAPPER_SIMD_X86)
+/* Gather instructions of AVX2 and AVX-512. They are compiled out of line (and
+   take their arguments in memory), as kernels only get the instruction set
+   of their `SimdLevel` once they are inlined into the dispatch function. */
+void gatherAVX2(const float *table, const int32_t *indices, float *values);
+void gatherAVX512(const float *table, const int32_t *indices, float *values);
+#endif
+
+// Entries of `table` at the indices in all lanes
+template <typename F>
+TONEMAPPER_SIMD_INLINE F gather(const float *table, Mask<F> index) {
+    constexpr size_t Width = sizeof(F) / sizeof(float);
+    int32_t indices[Width];
+    float values[Width];
+    std::memcpy(indices, &index, sizeof(index));
+#if defined(TONEMAPPER_SIMD_X86)
+    if constexpr (Width == 8) {
+        gatherAVX2(table, indices, values);
+    } else if constexpr (Width == 16) {
+        gatherAVX512(table, indices, values);
+    } else
+#endif
+    {
+        for (size_t l = 0; l < Width; ++l) {
+            values[l] = table[indices[l]];
+        }
+    }
+    F result;
+    std::memcpy(&result, values, sizeof(result));
+    return result;
+}
+
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F interpolate(const float *curve, size_t size, F position) {
+    typedef Mask<F> I;
+    I k     = __builtin_convertvector(position, I),
+      last  = I{} + int32_t(size - 2),
+      below = k < last;
+    k = (k & below) | (last & ~below);
+    F value = gather<F>(curve, k + k),
+      slope = gather<F>(curve + 1, k + k);
+    return value + (position - __builtin_convertvector(k, F)) * slope;
+}
+
+/* Polynomial approximations of exp and log, following the single precision
+   versions of the Cephes math library (about 2 ulp of error). */
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F exp(F x) {
+    typedef Mask<F> I;
+    x = min(max(x, F{} - 87.3365447f), F{} + 88.3762626f);
+
+    // Round x / ln(2) to the nearest integer n, using the float mantissa
+    F t = x * 1.44269504f + 12582912.f,
+      n = t - 12582912.f;
+
+    // Reduce argument to [-ln(2)/2, ln(2)/2]
+    x = x - n * 0.693359375f + n * 2.12194440e-4f;
+
+    F y = x * 1.9875691500e-4f + 1.3981999507e-3f;
+    y = y * x + 8.3334519073e-3f;
+    y = y * x + 4.1665795894e-2f;
+    y = y * x + 1.6666665459e-1f;
+    y = y * x + 5.0000001201e-1f;
+    y = y * x * x + x + 1.f;
+
+    // Scale by 2^n, built directly from the exponent bits
+    I pow2n = ((I) t - 0x4B400000 + 127) << 23;
+    return y * (F) pow2n;
+}
+
+// Natural logarithm for x > 0
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F log(F x) {
+    typedef Mask<F> I;
+    I bits = (I) x;
+
+    // Split into exponent e and mantissa m in [0.5, 1)
+    F e = (F) ((bits >> 23) | 0x4B000000) - (8388608.f + 126.f),
+      m = (F) ((bits & 0x007FFFFF) | 0x3F000000);
+
+    // Shift mantissa to [sqrt(0.5), sqrt(2)) and subtract one
+    I small = m < 0.707106781f;
+    e = select(small, e - 1.f, e);
+    m = select(small, m + m, m) - 1.f;
+
+    F z = m * m,
+      y = m * 7.0376836292e-2f - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+
+    y = y - e * 2.12194440e-4f - 0.5f * z;
+    return m + y + e * 0.693359375f;
+}
+
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F log10(F x) {
+    return log(x) * 0.434294482f;
+}
+
+// Power function for x > 0, returns zero for all other bases
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F pow(F x, F y) {
+    return select(x > 0.f, exp(y * log(x)), 0.f);
+}
+
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F pow(F x, float y) {
+    return pow(x, F{} + y);
+}
+
+typedef uint16_t Half4  __attribute__((vector_size(8)));
+typedef uint16_t Half8  __attribute__((vector_size(16)));
+typedef uint16_t Half16 __attribute__((vector_size(32)));
+
+// Vector of half floats with the same number of lanes
+template <typename F> struct HalfVector;
+template <> struct HalfVector<Float4>  { typedef Half4  Type; };
+template <> struct HalfVector<Float8>  { typedef Half8  Type; };
+template <> struct HalfVector<Float16> { typedef Half16 Type; };
+
+/* Load and convert one vector of consecutive half floats, the vectorized
+   counterpart to `halfToFloat`. The conversion only uses integer operations
+   on the widened lanes, so it works for every instruction set. */
+template <typename F, typename = Mask<F>>
+TONEMAPPER_SIMD_INLINE F loadHalf(const uint16_t *p) {
+    typedef Mask<F> I;
+    typename HalfVector<F>::Type h;
+    std::memcpy(&h, p, sizeof(h));
+
+    I bits = __builtin_convertvector(h, I),
+      shiftedExponent = I{} + (0x7c00 << 13),
+      o = (bits & 0x7fff) << 13,
+      exponent = o & shiftedExponent;
+    o += (127 - 15) << 23;
+    o += (exponent == shiftedExponent) & ((128 - 16) << 23);   // Infinity or NaN
+
+    // Denormals are renormalized with a float subtraction
+    I denormal = exponent == 0;
+    o += denormal & (1 << 23);
+    F f = select(denormal, (F) o - 6.103515625e-05f, (F) o);
+    return (F) ((I) f | ((bits & 0x8000) << 16));
+}
+
+/* Vectorized counterpart to `Color3f`, holding the colors of several pixels
+   in separate R, G, B vectors. It provides the subset of the `Color3f`
+   interface that the operator kernels need. */
+template <typename F>
+struct Color3v {
+    Color3v() = default;
+
+    Color3v(float v) {
+        c[0] = c[1] = c[2] = F{} + v;
+    }
+
+    explicit Color3v(F v) {
+        c[0] = c[1] = c[2] = v;
+    }
+
+    explicit Color3v(const Color3f &v) {
+        c[0] = F{} + v.r();
+        c[1] = F{} + v.g();
+        c[2] = F{} + v.b();
+    }
+
+    Color3v(F r, F g, F b) {
+        c[0] = r;
+        c[1] = g;
+        c[2] = b;
+    }
+
+    TONEMAPPER_SIMD_INLINE Color3v operator+(const Color3v &c2) const { return Color3v(c[0] + c2.c[0], c[1] + c2.c[1], c[2] + c2.c[2]); }
+    TONEMAPPER_SIMD_INLINE Color3v operator-(const Color3v &c2) const { return Color3v(c[0] - c2.c[0], c[1] - c2.c[1], c[2] - c2.c[2]); }
+    TONEMAPPER_SIMD_INLINE Color3v operator*(const Color3v &c2) const { return Color3v(c[0] * c2.c[0], c[1] * c2.c[1], c[2] * c2.c[2]); }
+    TONEMAPPER_SIMD_INLINE Color3v operator/(const Color3v &c2) const { return Color3v(c[0] / c2.c[0], c[1] / c2.c[1], c[2] / c2.c[2]); }
+
+    TONEMAPPER_SIMD_INLINE Color3v operator+(F s) const { return Color3v(c[0] + s, c[1] + s, c[2] + s); }
+    TONEMAPPER_SIMD_INLINE Color3v operator-(F s) const { return Color3v(c[0] - s, c[1] - s, c[2] - s); }
+    TONEMAPPER_SIMD_INLINE Color3v operator*(F s) const { return Color3v(c[0] * s, c[1] * s, c[2] * s); }
+    TONEMAPPER_SIMD_INLINE Color3v operator/(F s) const { return Color3v(c[0] / s, c[1] / s, c[2] / s); }
+
+    TONEMAPPER_SIMD_INLINE Color3v operator+(float s) const { return Color3v(c[0] + s, c[1] + s, c[2] + s); }
+    TONEMAPPER_SIMD_INLINE Color3v operator-(float s) const { return Color3v(c[0] - s, c[1] - s, c[2] - s); }
+    TONEMAPPER_SIMD_INLINE Color3v operator*(float s) const { return Color3v(c[0] * s, c[1] * s, c[2] * s); }
+    TONEMAPPER_SIMD_INLINE Color3v operator/(float s) const { return Color3v(c[0] / s, c[1] / s, c[2] / s); }
+
+    TONEMAPPER_SIMD_INLINE Color3v &operator*=(float s) { return *this = *this * s; }
+    TONEMAPPER_SIMD_INLINE Color3v &operator/=(float s) { return *this = *this / s; }
+
+    TONEMAPPER_SIMD_INLINE friend Color3v operator+(F s, const Color3v &c) { return Color3v(s + c.c[0], s + c.c[1], s + c.c[2]); }
+    TONEMAPPER_SIMD_INLINE friend Color3v operator*(F s, const Color3v &c) { return Color3v(s * c.c[0], s * c.c[1], s * c.c[2]); }
+    TONEMAPPER_SIMD_INLINE friend Color3v operator*(float s, const Color3v &c) { return c * s; }
+
+    TONEMAPPER_SIMD_INLINE friend Color3v pow(const Color3v &c, float exponent) {
+        return Color3v(simd::pow(c.c[0], exponent), simd::pow(c.c[1], exponent), simd::pow(c.c[2], exponent));
+    }
+
+    TONEMAPPER_SIMD_INLINE friend Color3v exp(const Color3v &c) {
+        return Color3v(simd::exp(c.c[0]), simd::exp(c.c[1]), simd::exp(c.c[2]));
+    }
+
+    // Same semantics as the `Color3f` versions
+    TONEMAPPER_SIMD_INLINE friend Color3v clamp(const Color3v &c, float low, float high) {
+        return clamp(c, Color3v(low), Color3v(high));
+    }
+
+    TONEMAPPER_SIMD_INLINE friend Color3v clamp(const Color3v &c, const Color3v &low, const Color3v &high) {
+        Color3v ret;
+        for (int i = 0; i < 3; ++i) {
+            ret.c[i] = simd::max(simd::min(c.c[i], high.c[i]), low.c[i]);
+        }
+        return ret;
+    }
+
+    TONEMAPPER_SIMD_INLINE friend Color3v max(const Color3v &c1, const Color3v &c2) {
+        return Color3v(simd::max(c1.c[0], c2.c[0]), simd::max(c1.c[1], c2.c[1]), simd::max(c1.c[2], c2.c[2]));
+    }
+
+    TONEMAPPER_SIMD_INLINE friend F luminance(const Color3v &c) {
+        return c.c[0] * 0.212671f + c.c[1] * 0.715160f + c.c[2] * 0.072169f;
+    }
+
+    TONEMAPPER_SIMD_INLINE friend F luminanceRods(const Color3v &c) {
+        F X = 0.412453f * c.r() + 0.357580f * c.g() + 0.180423f * c.b(),
+          Y = 0.212671f * c.r() + 0.715160f * c.g() + 0.072169f * c.b(),
+          Z = 0.019334f * c.r() + 0.119193f * c.g() + 0.950227f * c.b();
+        return -0.702f * X + 1.039f * Y + 0.433f * Z;
+    }
+
+    const F &r() const { return c[0]; }
+    const F &g() const { return c[1]; }
+    const F &b() const { return c[2]; }
+
+    F c[3];
+};
+
+/* Load `count` <= `Width` pixels starting at `offset` into per-channel
+   vectors. Planar spans are read with contiguous loads, interleaved ones are
+   transposed, and half floats are converted in the vector registers. A
+   partial batch is padded with zeros. */
+template <typename F>
+TONEMAPPER_SIMD_INLINE Color3v<F> loadPixels(const ConstPixelSpan &in, size_t offset, size_t count) {
+    constexpr size_t Width = sizeof(F) / sizeof(float);
+    Color3v<F> result;
+    if (in.isHalf()) {
+        uint16_t halfs[3][Width] = {};
+        for (size_t ch = 0; ch < 3; ++ch) {
+            const uint16_t *src = in.halfChannels[ch] + offset;
+            if (count < Width) {
+                std::memcpy(halfs[ch], src, count * sizeof(uint16_t));
+                src = halfs[ch];
+            }
+            result.c[ch] = loadHalf<F>(src);
+        }
+        return result;
+    }
+
+    if (in.isPlanar() && count == Width) {
+        for (size_t ch = 0; ch < 3; ++ch) {
+            std::memcpy(&result.c[ch], in.channels[ch] + offset, sizeof(F));
+        }
+        return result;
+    }
+
+    float channels[3][Width] = {};
+    for (size_t j = 0; j < count; ++j) {
+        for (size_t ch = 0; ch < 3; ++ch) {
+            channels[ch][j] = in.channels[ch][(offset + j) * in.stride];
+        }
+    }
+    for (size_t ch = 0; ch < 3; ++ch) {
+        std::memcpy(&result.c[ch], channels[ch], sizeof(F));
+    }
+    return result;
+}
+
+template <typename F>
+TONEMAPPER_SIMD_INLINE void storePixels(const PixelSpan &out, size_t offset, size_t count, const Color3v<F> &c) {
+    constexpr size_t Width = sizeof(F) / sizeof(float);
+    if (out.isPlanar() && !out.isHalf() && count == Width) {
+        for (size_t ch = 0; ch < 3; ++ch) {
+            std::memcpy(out.channels[ch] + offset, &c.c[ch], sizeof(F));
+        }
+        return;
+    }
+
+    float channels[3][Width];
+    for (size_t ch = 0; ch < 3; ++ch) {
+        std::memcpy(channels[ch], &c.c[ch], sizeof(F));
+    }
+    for (size_t j = 0; j < count; ++j) {
+        out.set(offset + j, Color3f(channels[0][j], channels[1][j], channels[2][j]));
+    }
+}
+
+// Apply `kernel` to `n` pixels, `Width` at a time
+template <typename F, typename Kernel>
+TONEMAPPER_SIMD_INLINE void mapPixelsVector(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure, const Kernel &kernel) {
+    constexpr size_t Width = sizeof(F) / sizeof(float);
+    for (size_t i = 0; i < n; i += Width) {
+        size_t count = std::min(Width, n - i);
+        Color3v<F> Cin = loadPixels<F>(in, i, count);
+        storePixels<F>(out, i, count, kernel(exposure * Cin));
+    }
+}
+
+#if defined(TONEMAPPER_SIMD_X86)
+template <typename Func>
+void dispatchSSE(const Func &func) {
+    func(Float4());
+}
+
+template <typename Func>
+__attribute__((target("avx2,fma")))
+void dispatchAVX2(const Func &func) {
+    func(Float8());
+}
+
+template <typename Func>
+__attribute__((target("avx512f,avx2,fma")))
+void dispatchAVX512(const Func &func) {
+    func(Float16());
+}
+#endif
+
+#endif // TONEMAPPER_SIMD_ENABLED
+
+/* Call the generic lambda `func` with a (dummy) value of the float type that
+   matches the active `SimdLevel`, i.e. `float` for the scalar code path or
+   one of the vector types. The call is compiled for the corresponding
+   instruction set, which requires `func` (and everything it calls) to be
+   marked with `TONEMAPPER_SIMD_KERNEL` or `TONEMAPPER_SIMD_INLINE`. */
+template <typename Func>
+void dispatch(const Func &func) {
+    switch (getSimdLevel()) {
+#if defined(TONEMAPPER_SIMD_X86)
+    case SimdLevel::SSE:    dispatchSSE(func);    return;
+    case SimdLevel::AVX2:   dispatchAVX2(func);   return;
+    case SimdLevel::AVX512: dispatchAVX512(func); return;
+#elif defined(TONEMAPPER_SIMD_NEON)
+    case SimdLevel::NEON:   func(Float4());       return;
+#endif
+    default:
+        func(0.f);
+    }
+}
+
+/* Map `n` pixels with a generic `kernel` lambda that takes the exposed input
+   color and returns the final output color. The kernel is instantiated both
+   for `Color3f` (the exact scalar reference) and for `Color3v` with the
+   vector width of the active `SimdLevel`, so it should be written in terms
+   of the `simd::` math functions and be marked with `TONEMAPPER_SIMD_KERNEL`.
+   `in` and `out` may alias. The vector versions are fastest on planar spans. */
+template <typename Kernel>
+void mapPixels(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure, const Kernel &kernel) {
+    dispatch([&](auto width) TONEMAPPER_SIMD_KERNEL {
+        typedef decltype(width) F;
+        if constexpr (std::is_same<F, float>::value) {
+            for (size_t i = 0; i < n; ++i) {
+                out.set(i, kernel(exposure * in.get(i)));
+            }
+        } else {
+#if defined(TONEMAPPER_SIMD_ENABLED)
+            mapPixelsVector<F>(in, out, n, exposure, kernel);
+#endif
+        }
+    });
+}
+
+} // Namespace simd
+
+} // Namespace tonemapper
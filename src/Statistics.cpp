@@ -0,0 +1,332 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#include <Statistics.h>
+
+#include <Image.h>
+#include <Parallel.h>
+#include <Simd.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace tonemapper {
+
+namespace {
+
+/* Partial statistics of a block of rows. Sums are kept in double precision so
+   that large images do not lose the contribution of individual pixels. */
+struct MomentsPartial {
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    float max[3] = { -std::numeric_limits<float>::infinity(),
+                     -std::numeric_limits<float>::infinity(),
+                     -std::numeric_limits<float>::infinity() };
+    float minimumLuminance =  std::numeric_limits<float>::infinity(),
+          maximumLuminance = -std::numeric_limits<float>::infinity(),
+          minimumPositiveLuminance = std::numeric_limits<float>::infinity();
+    double sumLuminance = 0.0,
+           sumLogLuminance = 0.0;
+    size_t logCount = 0;
+
+    void add(const Color3f &color) {
+        for (size_t ch = 0; ch < 3; ++ch) {
+            sum[ch] += color[ch];
+            max[ch] = std::max(max[ch], color[ch]);
+        }
+
+        float L = luminance(color);
+        minimumLuminance = std::min(minimumLuminance, L);
+        maximumLuminance = std::max(maximumLuminance, L);
+        sumLuminance += L;
+
+        if (L > 0.f) {
+            /* Be careful here as the log is only defined for non-zero
+               luminance values.
+               "Image Processing Techniques" by McReynolds et al. 2005
+               suggest to alternatively add a small `delta` biasing term to
+               avoid log(0), but this is not sufficient in case the image
+               contains many black pixels. */
+            minimumPositiveLuminance = std::min(minimumPositiveLuminance, L);
+            sumLogLuminance += std::log(L);
+            logCount++;
+        }
+    }
+
+    void merge(const MomentsPartial &other) {
+        for (size_t ch = 0; ch < 3; ++ch) {
+            sum[ch] += other.sum[ch];
+            max[ch] = std::max(max[ch], other.max[ch]);
+        }
+        minimumLuminance = std::min(minimumLuminance, other.minimumLuminance);
+        maximumLuminance = std::max(maximumLuminance, other.maximumLuminance);
+        minimumPositiveLuminance = std::min(minimumPositiveLuminance, other.minimumPositiveLuminance);
+        sumLuminance    += other.sumLuminance;
+        sumLogLuminance += other.sumLogLuminance;
+        logCount        += other.logCount;
+    }
+};
+
+/* Number of rows processed as one block. This is independent of the thread
+   count, so the statistics come out bit-identical no matter how the blocks are
+   scheduled. */
+constexpr size_t BlockRows = 16;
+
+inline size_t blockCount(const Image &image) {
+    return (image.getHeight() + BlockRows - 1) / BlockRows;
+}
+
+// Sum of all lanes of `v`
+template <typename F>
+TONEMAPPER_SIMD_INLINE double reduceAdd(F v) {
+    double result = 0.0;
+    for (size_t k = 0; k < sizeof(F) / sizeof(float); ++k) result += v[k];
+    return result;
+}
+
+template <typename F>
+TONEMAPPER_SIMD_INLINE void accumulateRow(const ConstPixelSpan &pixels, size_t width, MomentsPartial &partial) {
+    constexpr size_t W = sizeof(F) / sizeof(float);
+    const float inf = std::numeric_limits<float>::infinity();
+
+    /* Per-lane accumulators for the full batches of the row. They are flushed
+       into the double precision partial at the end of the row. */
+    simd::Color3v<F> sum(0.f), maximum(-inf);
+    F minimumLuminance = F() + inf,
+      maximumLuminance = F() - inf,
+      minimumPositiveLuminance = F() + inf,
+      sumLuminance     = F();
+
+    size_t j = 0;
+    for (; j + W <= width; j += W) {
+        simd::Color3v<F> color = simd::loadPixels<F>(pixels, j, W);
+        sum = sum + color;
+        maximum = max(maximum, color);
+
+        F L = luminance(color);
+        minimumLuminance = simd::min(minimumLuminance, L);
+        maximumLuminance = simd::max(maximumLuminance, L);
+        sumLuminance += L;
+
+        // Non-positive values are masked out, see `MomentsPartial::add`
+        auto positive = L > 0.f;
+        minimumPositiveLuminance = simd::min(minimumPositiveLuminance, simd::select(positive, L, inf));
+
+        /* The logs are exact and summed in the order of the pixels, as with the
+           scalar code, so that the log-mean luminance (and all operators that
+           use it) does not depend on the SIMD level. */
+        for (size_t k = 0; k < W; ++k) {
+            if (L[k] > 0.f) {
+                partial.sumLogLuminance += std::log(L[k]);
+                partial.logCount++;
+            }
+        }
+    }
+
+    for (size_t ch = 0; ch < 3; ++ch) {
+        partial.sum[ch] += reduceAdd(sum.c[ch]);
+        for (size_t k = 0; k < W; ++k) {
+            partial.max[ch] = std::max(partial.max[ch], maximum.c[ch][k]);
+        }
+    }
+    for (size_t k = 0; k < W; ++k) {
+        partial.minimumLuminance = std::min(partial.minimumLuminance, minimumLuminance[k]);
+        partial.maximumLuminance = std::max(partial.maximumLuminance, maximumLuminance[k]);
+        partial.minimumPositiveLuminance = std::min(partial.minimumPositiveLuminance, minimumPositiveLuminance[k]);
+    }
+    partial.sumLuminance += reduceAdd(sumLuminance);
+
+    // Remaining pixels that do not fill a whole batch
+    for (; j < width; ++j) {
+        partial.add(pixels.get(j));
+    }
+}
+
+} // Anonymous namespace
+
+void ImageStatistics::precompute() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    moments();
+}
+
+Color3f ImageStatistics::getMean() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return moments().mean;
+}
+
+Color3f ImageStatistics::getMaximum() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return moments().max;
+}
+
+float ImageStatistics::getMinimumLuminance() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return moments().minimumLuminance;
+}
+
+float ImageStatistics::getMaximumLuminance() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return moments().maximumLuminance;
+}
+
+float ImageStatistics::getMeanLuminance() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return moments().meanLuminance;
+}
+
+float ImageStatistics::getLogMeanLuminance() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return moments().logMeanLuminance;
+}
+
+float ImageStatistics::getLuminancePercentile(float p) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const std::vector<float> &sorted = sortedLuminance();
+    if (sorted.empty()) {
+        return 0.f;
+    }
+
+    float x = std::clamp(p, 0.f, 1.f) * float(sorted.size() - 1);
+    size_t i = std::min(size_t(x), sorted.size() - 1),
+           k = std::min(i + 1, sorted.size() - 1);
+    float t = x - float(i);
+    return (1.f - t) * sorted[i] + t * sorted[k];
+}
+
+LuminanceHistogram ImageStatistics::getLuminanceHistogram(size_t bins) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t current = generation();
+    Cached<LuminanceHistogram> &cached = m_histograms[bins];
+    if (cached.generation == current) {
+        return cached.value;
+    }
+
+    const Moments &m = moments();
+    LuminanceHistogram histogram;
+    histogram.counts.resize(bins, 0);
+    if (bins > 0 && m.minimumPositiveLuminance <= m.maximumLuminance) {
+        histogram.minimum = m.minimumPositiveLuminance;
+        histogram.maximum = m.maximumLuminance;
+
+        float lo = std::log2(histogram.minimum),
+              hi = std::log2(histogram.maximum),
+              scale = hi > lo ? float(bins) / (hi - lo) : 0.f;
+
+        size_t width = m_image.getWidth(),
+               height = m_image.getHeight(),
+               blocks = blockCount(m_image);
+        std::vector<std::vector<size_t>> partials(blocks, std::vector<size_t>(bins, 0));
+        ThreadPool::get().parallelFor(blocks, [&](size_t block) {
+            std::vector<size_t> &counts = partials[block];
+            for (size_t i = block * BlockRows; i < std::min((block + 1) * BlockRows, height); ++i) {
+                ConstPixelSpan pixels = m_image.row(i);
+                for (size_t j = 0; j < width; ++j) {
+                    float L = luminance(pixels.get(j));
+                    if (L > 0.f) {
+                        size_t bin = size_t(std::max(0.f, (std::log2(L) - lo) * scale));
+                        counts[std::min(bin, bins - 1)]++;
+                    }
+                }
+            }
+        });
+
+        for (const std::vector<size_t> &counts : partials) {
+            for (size_t b = 0; b < bins; ++b) {
+                histogram.counts[b] += counts[b];
+            }
+        }
+    }
+
+    cached.generation = current;
+    cached.value = histogram;
+    return histogram;
+}
+
+const ImageStatistics::Moments &ImageStatistics::moments() const {
+    uint64_t current = generation();
+    if (m_moments.generation == current) {
+        return m_moments.value;
+    }
+
+    size_t width = m_image.getWidth(),
+           height = m_image.getHeight(),
+           blocks = blockCount(m_image);
+    std::vector<MomentsPartial> partials(std::max(size_t(1), blocks));
+
+    ThreadPool::get().parallelFor(blocks, [&](size_t block) {
+        size_t i0 = block * BlockRows,
+               i1 = std::min(i0 + BlockRows, height);
+        MomentsPartial &partial = partials[block];
+
+        simd::dispatch([&](auto lanes) TONEMAPPER_SIMD_KERNEL {
+            typedef decltype(lanes) F;
+            for (size_t i = i0; i < i1; ++i) {
+                ConstPixelSpan pixels = m_image.row(i);
+                if constexpr (std::is_same<F, float>::value) {
+                    for (size_t j = 0; j < width; ++j) {
+                        partial.add(pixels.get(j));
+                    }
+                } else {
+                    accumulateRow<F>(pixels, width, partial);
+                }
+            }
+        });
+    });
+
+    // Combine the blocks pairwise, in a fixed order
+    for (size_t step = 1; step < partials.size(); step *= 2) {
+        for (size_t i = 0; i + step < partials.size(); i += 2 * step) {
+            partials[i].merge(partials[i + step]);
+        }
+    }
+    const MomentsPartial &total = partials[0];
+
+    double pixelCount = double(width * height);
+    Moments &m = m_moments.value;
+    m.mean = Color3f(float(total.sum[0] / pixelCount),
+                     float(total.sum[1] / pixelCount),
+                     float(total.sum[2] / pixelCount));
+    m.max = Color3f(total.max[0], total.max[1], total.max[2]);
+    m.minimumLuminance = total.minimumLuminance;
+    m.maximumLuminance = total.maximumLuminance;
+    m.minimumPositiveLuminance = total.minimumPositiveLuminance;
+    m.meanLuminance = float(total.sumLuminance / pixelCount);
+
+    /* Eq. (1) in Eq. (1) in "Photographic Tone Reproduction for Digital Images"
+       by Reinhard et al. 2002. divides by N after exponentiating. But this does not
+       give sensible values here. Instead, the whole expression should be equivalent
+       to computing a geometric mean. */
+    m.logMeanLuminance = float(std::exp(total.sumLogLuminance / double(total.logCount)));
+
+    m_moments.generation = current;
+    return m;
+}
+
+const std::vector<float> &ImageStatistics::sortedLuminance() const {
+    uint64_t current = generation();
+    if (m_sortedLuminance.generation == current) {
+        return m_sortedLuminance.value;
+    }
+
+    size_t width = m_image.getWidth(),
+           height = m_image.getHeight();
+    std::vector<float> &sorted = m_sortedLuminance.value;
+    sorted.resize(width * height);
+    ThreadPool::get().parallelFor(blockCount(m_image), [&](size_t block) {
+        for (size_t i = block * BlockRows; i < std::min((block + 1) * BlockRows, height); ++i) {
+            ConstPixelSpan pixels = m_image.row(i);
+            for (size_t j = 0; j < width; ++j) {
+                sorted[i * width + j] = luminance(pixels.get(j));
+            }
+        }
+    });
+    std::sort(sorted.begin(), sorted.end());
+
+    m_sortedLuminance.generation = current;
+    return sorted;
+}
+
+} // Namespace tonemapper
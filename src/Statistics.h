@@ -0,0 +1,96 @@
+/*
+    Copyright (c) 2022 Tizian Zeltner
+
+    tonemapper is provided under the MIT License.
+    See the LICENSE.txt file for the conditions of the license.
+*/
+
+#pragma once
+
+#include <Global.h>
+#include <Color.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+namespace tonemapper {
+
+class Image;
+
+// Histogram of the log2 luminance of an image
+struct LuminanceHistogram {
+    /* Luminance range covered by the bins. Bins are spaced uniformly in log2
+       space between the smallest positive and the largest luminance. */
+    float minimum = 0.f,
+          maximum = 0.f;
+
+    // Pixel count per bin, pixels with zero (or negative) luminance are skipped
+    std::vector<size_t> counts;
+};
+
+/* Statistics of the pixels of an `Image` that are used to drive some of the
+   operators. Each statistic is computed on first access and then cached until
+   the pixels are modified, so operators that need none of them never pay for
+   an extra pass over the image. Statistics that are computed in the same pass
+   (mean, maximum, luminance range, mean and log-mean luminance) are cached
+   together. */
+class ImageStatistics {
+public:
+    ImageStatistics(const Image &image) : m_image(image) {}
+
+    // Drop all cached statistics, called whenever the pixels are modified
+    inline void invalidate() { m_generation.fetch_add(1, std::memory_order_relaxed); }
+
+    // Compute the statistics that are based on a single pass right away
+    void precompute() const;
+
+    Color3f getMean() const;
+    Color3f getMaximum() const;
+    float getMinimumLuminance() const;
+    float getMaximumLuminance() const;
+    float getMeanLuminance() const;
+    float getLogMeanLuminance() const;
+
+    /* Luminance value below which a fraction `p` (in [0, 1]) of the pixels
+       lie, linearly interpolated between neighboring pixels. The first call
+       sorts the luminance of all pixels. */
+    float getLuminancePercentile(float p) const;
+
+    // Histogram with `bins` bins, cached separately for each bin count
+    LuminanceHistogram getLuminanceHistogram(size_t bins) const;
+
+private:
+    struct Moments {
+        Color3f mean,
+                max;
+        float minimumLuminance,
+              maximumLuminance,
+              minimumPositiveLuminance,
+              meanLuminance,
+              logMeanLuminance;
+    };
+
+    // Value together with the pixel generation it was computed for
+    template <typename T>
+    struct Cached {
+        uint64_t generation = ~uint64_t(0);
+        T value;
+    };
+
+    const Moments &moments() const;
+    const std::vector<float> &sortedLuminance() const;
+
+    inline uint64_t generation() const { return m_generation.load(std::memory_order_relaxed); }
+
+private:
+    const Image &m_image;
+    std::atomic<uint64_t> m_generation{0};
+
+    mutable std::mutex m_mutex;
+    mutable Cached<Moments> m_moments;
+    mutable Cached<std::vector<float>> m_sortedLuminance;
+    mutable std::map<size_t, Cached<LuminanceHistogram>> m_histograms;
+};
+
+} // Namespace tonemapper
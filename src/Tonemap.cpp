@@ -8,6 +8,7 @@
 #include <Tonemap.h>
 
 #include <Image.h>
+#include <Parallel.h>
 #ifdef TONEMAPPER_BUILD_GUI
     #include <nanogui/shader.h>
 #endif
@@ -34,18 +35,105 @@ TonemapOperator::~TonemapOperator() {}
 
 void TonemapOperator::preprocess(const Image */*image*/) {}
 
+void TonemapOperator::updateParameters() {
+    for (CompiledParametersBase *block : m_compiledParameters) {
+        block->update(parameters);
+    }
+}
+
+Color3f TonemapOperator::map(const Color3f &c, float exposure) const {
+    Color3f result;
+    mapSpan(&c, &result, 1, exposure);
+    return result;
+}
+
+void TonemapOperator::mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const {
+    for (size_t i = 0; i < n; ++i) {
+        out.set(i, map(in.get(i), exposure));
+    }
+}
+
+namespace {
+
+// Tasks finish out of order, so only ever move the progress forward
+void advanceProgress(std::atomic<float> *progress, std::atomic<size_t> &tasksDone, size_t taskCount) {
+    if (!progress) return;
+    float done = float(++tasksDone) / float(taskCount),
+          current = progress->load();
+    while (current < done && !progress->compare_exchange_weak(current, done)) {}
+}
+
+} // Anonymous namespace
+
 // Process each pixel in the image
-void TonemapOperator::process(const Image *input, Image *output, float exposure, float *progress) const {
+void TonemapOperator::process(const Image *input, Image *output, float exposure, std::atomic<float> *progress) const {
+    if (progress) *progress = 0.f;
+
+    size_t width     = input->getWidth(),
+           height    = input->getHeight(),
+           tile      = std::max(size_t(1), tileSize),
+           tilesX    = (width  + tile - 1) / tile,
+           tilesY    = (height + tile - 1) / tile,
+           tileCount = tilesX * tilesY;
+
+    std::atomic<size_t> tilesDone(0);
+    ThreadPool::get().parallelFor(tileCount, [&](size_t t) {
+        size_t x0 = (t % tilesX) * tile,
+               y0 = (t / tilesX) * tile,
+               x1 = std::min(x0 + tile, width),
+               y1 = std::min(y0 + tile, height);
+
+        for (size_t i = y0; i < y1; ++i) {
+            mapSpan(input->row(i, x0), output->row(i, x0), x1 - x0, exposure);
+        }
+
+        advanceProgress(progress, tilesDone, tileCount);
+    });
+}
+
+void TonemapOperator::processToLDR(const Image *input, uint8_t *dst, size_t stride, float exposure,
+                                   int bitDepth, Dither dither, std::atomic<float> *progress) const {
+    if (bitDepth != 8 && bitDepth != 16) {
+        ERROR("processToLDR(): Unsupported bit depth %d, expected 8 or 16.", bitDepth);
+    }
     if (progress) *progress = 0.f;
-    float delta = 1.f / (input->getWidth() * input->getHeight());
 
-    for (size_t i = 0; i < input->getHeight(); ++i) {
-        for (size_t j = 0; j < input->getWidth(); ++j) {
-            const Color3f &color = input->ref(i, j);
-            output->ref(i, j) = map(color, exposure);
-            if (progress) *progress += delta;
+    size_t width     = input->getWidth(),
+           height    = input->getHeight(),
+           bandRows  = std::max(size_t(1), tileSize),
+           bandCount = (height + bandRows - 1) / bandRows;
+
+    std::atomic<size_t> bandsDone(0);
+    ThreadPool::get().parallelFor(bandCount, [&](size_t band) {
+        size_t i0 = band * bandRows,
+               i1 = std::min(i0 + bandRows, height);
+
+        // Planar, so the SIMD kernels can store whole batches at once
+        Image scratch(width, 1, PixelLayout::Planar);
+        PixelSpan tonemapped = scratch.row(0);
+        for (size_t i = i0; i < i1; ++i) {
+            mapSpan(input->row(i), tonemapped, width, exposure);
+            if (bitDepth == 8) {
+                Image::quantize(tonemapped, width, dst + stride * i, dither, i);
+            } else {
+                Image::quantize(tonemapped, width, (uint16_t *) (dst + stride * i), dither, i);
+            }
         }
+
+        advanceProgress(progress, bandsDone, bandCount);
+    });
+}
+
+float TonemapOperator::mapLuminance(float L, float /*exposure*/) const {
+    return L;
+}
+
+float TonemapOperator::mapDisplay(float x) const {
+    auto it = parameters.find("gamma");
+    if (it != parameters.end()) {
+        x = std::pow(x, 1.f / it->second.value);
     }
+    return std::clamp(x, 0.f, 1.f);
 }
 
 void TonemapOperator::fromFile(const std::string &/*filename*/) {}
@@ -57,9 +145,26 @@ TonemapOperator *TonemapOperator::create(const std::string &name) {
         ERROR("A constructor for class \"%s\" could not be found!", name);
     }
     TonemapOperator *op = (*constructors)[name]();
+    if (!op->traits.needsStatistics) {
+        op->updateParameters();
+    }
     return op;
 }
 
+TonemapOperator *TonemapOperator::clone(const std::string &name, const TonemapOperator *op) {
+    TonemapOperator *copy = create(name);
+    copy->parameters = op->parameters;
+    copy->tileSize   = op->tileSize;
+    copy->irradiance = op->irradiance;
+    for (size_t ch = 0; ch < 3; ++ch) {
+        copy->values[ch] = op->values[ch];
+    }
+    if (!copy->traits.needsStatistics) {
+        copy->updateParameters();
+    }
+    return copy;
+}
+
 void TonemapOperator::registerOperator(const std::string &name, const Constructor &constr) {
     if (!constructors) {
         constructors = new std::map<std::string, TonemapOperator::Constructor>();
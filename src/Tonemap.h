@@ -10,9 +10,12 @@
 #include <Global.h>
 #include <Color.h>
 #include <Image.h>
+#include <Simd.h>
 
+#include <atomic>
 #include <map>
 #include <functional>
+#include <limits>
 
 namespace tonemapper {
 
@@ -43,31 +46,158 @@ struct Parameter {
 
 typedef std::map<std::string, Parameter> ParameterMap;
 
+class TonemapOperator;
+
+// Part of `CompiledParameters` that does not depend on the block type
+class CompiledParametersBase {
+public:
+    virtual ~CompiledParametersBase() {}
+    virtual void update(const ParameterMap &parameters) = 0;
+};
+
+/* Flat, typed parameter block of an operator (including derived constants)
+   that is built from its `ParameterMap`, so that the per-pixel code never has
+   to look up parameters by name. Blocks register with their operator, which
+   rebuilds them in `TonemapOperator::updateParameters`. `mapSpan` then only
+   reads the block, and operators with the `luminanceScaled` trait build the
+   curves of `mapSpan` and `mapLuminance` from the same static function. */
+template <typename T>
+class CompiledParameters : public CompiledParametersBase {
+public:
+    typedef T (*Compiler)(const ParameterMap &parameters);
+
+    CompiledParameters(TonemapOperator *op, Compiler compile);
+
+    // Recompile the block if one of the parameter values changed
+    void update(const ParameterMap &parameters) override {
+        if (!changed(parameters)) return;
+        m_block = m_compile(parameters);
+        m_values.clear();
+        for (auto const &kv : parameters) {
+            m_values.push_back(kv.second.value);
+        }
+        m_valid = true;
+    }
+
+    // Block of the last `update`
+    const T &get() const { return m_block; }
+
+private:
+    bool changed(const ParameterMap &parameters) const {
+        if (!m_valid || m_values.size() != parameters.size()) return true;
+        size_t i = 0;
+        for (auto const &kv : parameters) {
+            if (kv.second.value != m_values[i++]) return true;
+        }
+        return false;
+    }
+
+private:
+    Compiler m_compile;
+    bool m_valid = false;
+    T m_block = T();
+    std::vector<float> m_values;
+};
+
 class Image;
 
+/* Properties that operators declare about themselves, so that they can be
+   applied with cheaper means than evaluating them for every pixel (see
+   `BakedOperator`). The defaults make no promises. */
+struct OperatorTraits {
+    // Each channel is mapped on its own, i.e. by a 1D curve per channel
+    bool separable = false;
+
+    /* The exposed color is scaled by the ratio of its tonemapped and original
+       luminance, see `TonemapOperator::mapLuminance`, followed by the display
+       curve `TonemapOperator::mapDisplay` on each channel. */
+    bool luminanceScaled = false;
+
+    // `preprocess` sets parameters from image statistics
+    bool needsStatistics = false;
+
+    /* The curves above (or, for all other operators, each output channel as a
+       function of the input) never decrease */
+    bool monotonic = false;
+
+    // Range of all output values
+    float outputMin = -std::numeric_limits<float>::infinity(),
+          outputMax =  std::numeric_limits<float>::infinity();
+};
+
 class TonemapOperator {
 public:
     TonemapOperator();
     virtual ~TonemapOperator();
 
+    TonemapOperator(const TonemapOperator &) = delete;
+    TonemapOperator &operator=(const TonemapOperator &) = delete;
+
     // Set some of the operator parameters based on image data (e.g. mean color)
     virtual void preprocess(const Image *image);
 
-    // Process each pixel in the image
-    void process(const Image *input, Image *output, float exposure, float *progress=nullptr) const;
-
-    // Actual tonemapping operator
-    virtual Color3f map(const Color3f &c, float exposure) const = 0;
+    /* Rebuild everything that is derived from `parameters` (and the response
+       function data). Callers do this after changing them or calling
+       `preprocess`, and never while the operator is in use. Operators with
+       the `needsStatistics` trait only have all parameters after
+       `preprocess`, all others returned by `create` are up to date. */
+    virtual void updateParameters();
+
+    /* Process each pixel in the image. The image is split into square tiles
+       that are distributed over the threads of the global `ThreadPool`. */
+    void process(const Image *input, Image *output, float exposure, std::atomic<float> *progress=nullptr) const;
+
+    // In-place version that overwrites `image` with the tonemapped result
+    void process(Image *image, float exposure, std::atomic<float> *progress=nullptr) const {
+        process(image, image, exposure, progress);
+    }
+
+    /* Tonemap and quantize straight into `dst` without a float output image.
+       `dst` holds interleaved RGB with 8 or 16 (`uint16_t`) bits per channel
+       and `stride` bytes between rows. The image is split into bands of
+       `tileSize` rows, each of which goes through a single scratch row. */
+    void processToLDR(const Image *input, uint8_t *dst, size_t stride, float exposure,
+                      int bitDepth=8, Dither dither=Dither::None, std::atomic<float> *progress=nullptr) const;
+
+    /* Actual tonemapping operator. Operators override at least one of `map`
+       and `mapSpan`, the default implementations are written in terms of each
+       other. */
+    virtual Color3f map(const Color3f &c, float exposure) const;
+
+    /* Tonemap `n` consecutive pixels, stored in either pixel layout. `in` and
+       `out` may point to the same memory. Overriding this allows operators to
+       fetch their parameters and set up derived constants once per span
+       instead of once per pixel. */
+    virtual void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const;
+
+    // Convenience version for interleaved pixels
+    void mapSpan(const Color3f *in, Color3f *out, size_t n, float exposure) const {
+        mapSpan(ConstPixelSpan(in), PixelSpan(out), n, exposure);
+    }
+
+    /* Tonemapped luminance for the exposed luminance `L`, only implemented by
+       operators with the `luminanceScaled` trait. */
+    virtual float mapLuminance(float L, float exposure) const;
+
+    /* Display curve that operators with the `luminanceScaled` trait apply to
+       each channel in the end. Defaults to the gamma curve of the "gamma"
+       parameter (if there is one), clamped to [0, 1]. */
+    virtual float mapDisplay(float x) const;
 
     virtual void fromFile(const std::string &filename);
 
 public:
+    OperatorTraits traits;
+
     ParameterMap parameters;
     std::string  name;
     std::string  description;
     std::string  vertexShader;
     std::string  fragmentShader;
 
+    // Edge length (in pixels) of the tiles processed by each task in `process`
+    size_t tileSize = 64;
+
     bool dataDriven = false;
     std::vector<float> irradiance;
     std::vector<float> values[3];
@@ -76,12 +206,27 @@ public:
     typedef std::function<TonemapOperator *()> Constructor;
 
     static TonemapOperator *create(const std::string &name);
+
+    /* New operator of class `name` with the parameters, tile size, and
+       response function data of `op`, which can be changed independently of
+       it. Up to date under the same conditions as the ones from `create`. */
+    static TonemapOperator *clone(const std::string &name, const TonemapOperator *op);
     static void registerOperator(const std::string &name, const Constructor &constr);
     static std::map<std::string, Constructor> *constructors;
 
     static std::vector<std::string> orderedNames();
+
+private:
+    template <typename T> friend class CompiledParameters;
+    std::vector<CompiledParametersBase *> m_compiledParameters;
 };
 
+template <typename T>
+CompiledParameters<T>::CompiledParameters(TonemapOperator *op, Compiler compile)
+    : m_compile(compile) {
+    op->m_compiledParameters.push_back(this);
+}
+
 #define REGISTER_OPERATOR(cls, name) \
     cls *cls##create() { \
         return new cls(); \
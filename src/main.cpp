@@ -9,7 +9,12 @@
 
 #include <Global.h>
 #include <Image.h>
+#include <Lut.h>
 #include <Tonemap.h>
+#include <Parallel.h>
+#include <Pipeline.h>
+#include <ResponseFunction.h>
+#include <Simd.h>
 
 #ifdef TONEMAPPER_BUILD_GUI
     #include <Gui.h>
@@ -17,9 +22,18 @@
 #endif
 
 #include <filesystem>
+#include <memory>
 
 using namespace tonemapper;
 
+/* Largest error of lookup tables that are used instead of the exact operators,
+   in quantization steps of the output format */
+constexpr float LutTolerance = 0.5f;
+
+/* Range in which baked 1D curves have to saturate when the image maximum is
+   not known, the largest half float */
+constexpr float LutSaturationRange = 65504.f;
+
 void printUsage() {
     PRINT("");
     PRINT("Usage:");
@@ -27,11 +41,13 @@ void printUsage() {
     PRINT("* Open GUI:");
     PRINT("    tonemapper");
     PRINT("* Tonemap a list of images (without GUI):");
-    PRINT("    tonemapper --no-gui <options> <list of images (.exr or .hdr format)>");
+    PRINT("    tonemapper --no-gui <options> <list of images (.exr, .hdr, .pfm or .raw format)>");
 #else
     PRINT("* Tonemap a list of images:");
-    PRINT("    tonemapper <options> <list of images (.exr or .hdr format)>");
+    PRINT("    tonemapper <options> <list of images (.exr, .hdr, .pfm or .raw format)>");
 #endif
+    PRINT("* Read from standard input and write to standard output:");
+    PRINT("    tonemapper <options> --stdout -");
     PRINT("* Get more information:");
     PRINT("    tonemapper --help");
     PRINT("");
@@ -55,6 +71,146 @@ void printHelp(const TonemapOperator *tm) {
     PRINT("  --output-jpg      Write output images in \".jpg\" format.");
     PRINT("");
     PRINT("  --output-png      Write output images in \".png\" format.");
+    PRINT("");
+    PRINT("  --output-tif      Write output images in 16-bit \".tif\" format.");
+    PRINT("");
+    PRINT("  --output-ppm      Write output images in 16-bit \".ppm\" format.");
+    PRINT("");
+    PRINT("  --output-exr      Write output images in \".exr\" format, without clamping");
+    PRINT("                    or quantizing the tonemapped values.");
+    PRINT("");
+    PRINT("  --bit-depth       Bits per channel of \".png\" files, either 8 or 16.");
+    PRINT("                    (Default: 8)");
+    PRINT("");
+    PRINT("  --exr-float       Store \".exr\" files with full instead of half float");
+    PRINT("                    precision.");
+    PRINT("");
+    PRINT("  --output-pfm      Write output images in \".pfm\" format, without clamping");
+    PRINT("                    or quantizing the tonemapped values.");
+    PRINT("");
+    PRINT("  --output-raw      Write output images as headerless \".raw\" files with");
+    PRINT("                    interleaved RGB floats, without clamping or quantizing.");
+    PRINT("");
+    PRINT("  --raw-size        Resolution of \".raw\" input images and of raw data on");
+    PRINT("                    standard input, e.g. \"1920x1080\".");
+    PRINT("");
+    PRINT("  --raw-half        \".raw\" files (input and output) hold half instead of");
+    PRINT("                    full precision floats.");
+    PRINT("");
+    PRINT("  --stdout          Write the output image to standard output, in the format");
+    PRINT("                    given by the \"--output-*\" options. All messages go to");
+    PRINT("                    standard error instead. Needs exactly one input image,");
+    PRINT("                    which can be \"-\" to read it from standard input.");
+    PRINT("");
+    PRINT("  --dither          Dithering of the quantized output, either \"none\"");
+    PRINT("                    (round to nearest), \"ordered\" (8 x 8 Bayer matrix), or");
+    PRINT("                    \"blue-noise\" (64 x 64 blue noise tile).");
+    PRINT("                    (Default: none)");
+    PRINT("");
+    PRINT("  --png-compression Deflate level of \".png\" files from 0 to 9. Level 0 stores");
+    PRINT("                    the pixels uncompressed and level 1 only compresses runs");
+    PRINT("                    of equal values, both for quick previews.");
+    PRINT("                    (Default: 4)");
+    PRINT("");
+    PRINT("  --jpg-quality     Quality of \".jpg\" files from 1 to 100.");
+    PRINT("                    (Default: 100)");
+    PRINT("");
+    PRINT("  --jpg-subsampling Chroma subsampling of \".jpg\" files, either \"444\" (none),");
+    PRINT("                    \"422\" (half horizontal), or \"420\" (half horizontal and");
+    PRINT("                    vertical color resolution).");
+    PRINT("                    (Default: 444)");
+    PRINT("");
+    PRINT("  --threads         Number of threads used for processing. A value of 0");
+    PRINT("                    uses all available hardware threads.");
+    PRINT("                    (Default: 0)");
+    PRINT("");
+    PRINT("  --tile-size       Edge length in pixels of the image tiles that are");
+    PRINT("                    distributed over the threads.");
+    PRINT("                    (Default: 64)");
+    PRINT("");
+    PRINT("  --deterministic   Use a static schedule without work stealing.");
+    PRINT("");
+    PRINT("  --jobs            Number of images that are processed at the same time, so");
+    PRINT("                    that reading, tonemapping and saving of different images");
+    PRINT("                    overlap. A value of 0 uses one per hardware thread.");
+    PRINT("                    (Default: 1)");
+    PRINT("");
+    PRINT("  --memory-budget   Approximate memory limit in MB for all images that are");
+    PRINT("                    processed at the same time. A value of 0 means no limit.");
+    PRINT("                    (Default: 0)");
+    PRINT("");
+    PRINT("  --layout          Memory layout of the images during processing, either");
+    PRINT("                    \"planar\" (separate color channels), \"interleaved\", or");
+    PRINT("                    \"half\" (planar with half precision, which halves the");
+    PRINT("                    memory used by the input images).");
+    PRINT("                    (Default: planar)");
+    PRINT("");
+    PRINT("  --part            Name or index of the part that is read from multi-part");
+    PRINT("                    \".exr\" files, e.g. \"beauty\". Other parts are skipped.");
+    PRINT("                    (Default: first part)");
+    PRINT("");
+    PRINT("  --channels        Channels of \".exr\" files that are read as RGB, e.g.");
+    PRINT("                    \"diffuse.R,diffuse.G,diffuse.B\", a layer such as");
+    PRINT("                    \"diffuse\", or a single channel that is read as gray.");
+    PRINT("                    (Default: R, G, B, or the first layer that has them)");
+    PRINT("");
+    PRINT("  --display-window  Read the display window of \".exr\" files instead of their");
+    PRINT("                    data window. Pixels outside of the data window are black.");
+    PRINT("");
+    PRINT("  --roi             Region of interest \"x,y,width,height\" in pixels that is");
+    PRINT("                    read from the input images, e.g. for crops or previews.");
+    PRINT("                    A width or height of 0 extends it to the image border.");
+    PRINT("");
+    PRINT("  --downsample      Integer factor by which the input images are downsampled");
+    PRINT("                    while they are read, averaging blocks of pixels. Tiled");
+    PRINT("                    \".exr\" files are read from the mip levels that cover");
+    PRINT("                    whole blocks, and from the full resolution elsewhere.");
+    PRINT("                    (Default: 1)");
+    PRINT("");
+    PRINT("  --simd            Instruction set used for the operator curves, one of");
+    PRINT("                    \"off\" (exact scalar code), \"sse\", \"avx2\", \"avx512\",");
+    PRINT("                    or \"neon\". Vectorized versions use fast approximations");
+    PRINT("                    of pow, exp, and log.");
+    PRINT("                    (Default: best one supported by the CPU)");
+    PRINT("");
+    PRINT("  --lut-size        Size \"N\" or \"N,M\" of the lookup tables that operators are");
+    PRINT("                    baked into for each image: N entries for operators that");
+    PRINT("                    map each channel on its own, or a 3D table with M");
+    PRINT("                    entries per axis for all others. Tables that are off by");
+    PRINT("                    more than half a step of the output bit depth are not");
+    PRINT("                    used, and float outputs are never baked. Tables cover the");
+    PRINT("                    image maximum if image statistics are computed anyway,");
+    PRINT("                    else the range of \"--lut-range\" or the inputs up to");
+    PRINT("                    where 1D curves saturate. Operators without such a range");
+    PRINT("                    are evaluated exactly.");
+    PRINT("                    (Default: 4096,65)");
+    PRINT("");
+    PRINT("  --exact           Evaluate the operators for every pixel instead of baking");
+    PRINT("                    them into lookup tables.");
+    PRINT("");
+    PRINT("  --export-lut      Write the operator with its parameters and the exposure");
+    PRINT("                    into a lookup table file for other applications instead");
+    PRINT("                    of tonemapping images, either \".cube\", \".spi1d\" (only");
+    PRINT("                    operators that map each channel on its own), or \".clf\".");
+    PRINT("                    Sizes are given by \"--lut-size\". Operators that use");
+    PRINT("                    image statistics and the \"exposure-key\" and");
+    PRINT("                    \"exposure-auto\" options need one input image.");
+    PRINT("");
+    PRINT("  --lut-shaper      Spacing of the entries of exported tables over the input");
+    PRINT("                    range, either \"linear\" or \"log2\". 1D tables in \".cube\"");
+    PRINT("                    and \".spi1d\" files are always spaced linearly.");
+    PRINT("                    (Default: log2)");
+    PRINT("");
+    PRINT("  --lut-range       Input range \"MAX\" or \"MIN,MAX\" of exported tables. MIN");
+    PRINT("                    is the smallest value of the log2 shaper. MAX is also the");
+    PRINT("                    largest input of the tables that operators are baked into,");
+    PRINT("                    larger values are clamped to it.");
+    PRINT("                    (Default: maximum of the input image or 1, and MAX * 2^-16)");
+    PRINT("");
+    PRINT("  --pack-rf         Pack response function files into the given \".rfpack\"");
+    PRINT("                    file instead of tonemapping images. The \".rf\" files (or");
+    PRINT("                    directories of them) follow, e.g. \"data/DoRF\". Entries");
+    PRINT("                    are named after the files, without their extension.");
 #ifdef TONEMAPPER_BUILD_GUI
     PRINT("");
     PRINT("  --no-gui          Do not open the GUI.");
@@ -98,7 +254,7 @@ void printHelp(const TonemapOperator *tm) {
         }
         if (tm->dataDriven) {
             std::string param = "  --file  ";
-            printMultiline("Path to a response function file.", 60, indentation, param);
+            printMultiline("Path to a response function file, or \"<pack>.rfpack:<name>\" for an entry of a pack (see \"--pack-rf\").", 60, indentation, param);
         }
         if (tm->parameters.size() == 0) {
             PRINT("  None.");
@@ -108,6 +264,13 @@ void printHelp(const TonemapOperator *tm) {
 }
 
 int main(int argc, char **argv) {
+    // Keep standard output free for the image data
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--stdout") {
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+    }
+
     PRINT("=========================");
     PRINT(" tonemapper v%s", VERSION);
     PRINT(" © %s Tizian Zeltner", YEAR);
@@ -120,8 +283,31 @@ int main(int argc, char **argv) {
     TonemapOperator *tm       = nullptr;
     ExposureMode exposureMode = ExposureMode::Value;
     float exposureInput       = 0.f;
-    bool saveAsJpg            = true;
+    std::string outputExtension = ".jpg";
+    SaveOptions saveOptions;
     bool openGUI              = true;
+    size_t threadCount        = 0;
+    size_t tileSize           = 64;
+    bool deterministic        = false;
+    size_t jobCount           = 1;
+    size_t memoryBudget       = 0;
+    SimdLevel simdLevel       = detectSimdLevel();
+    PixelLayout layout        = PixelLayout::Planar;
+    std::string exrPart;
+    std::string exrChannels;
+    bool displayWindow        = false;
+    size_t rawWidth           = 0,
+           rawHeight          = 0;
+    bool rawHalf              = false;
+    bool writeToStdout        = false;
+    size_t roi[4]             = { 0, 0, 0, 0 };
+    size_t downsample         = 1;
+    size_t lutSize[2]         = { 4096, 65 };
+    bool exact                = false;
+    std::string lutFilename;
+    LutExportOptions lutOptions;
+    bool lutRangeGiven        = false;
+    std::string packFilename;
 
     bool showHelp             = false;
     std::string operatorKey;
@@ -158,9 +344,262 @@ int main(int argc, char **argv) {
         } else if (token.compare("--exposure-auto") == 0) {
             exposureMode = ExposureMode::Auto;
         } else if (token.compare("--output-jpg") == 0) {
-            saveAsJpg = true;
+            outputExtension = ".jpg";
         } else if (token.compare("--output-png") == 0) {
-            saveAsJpg = false;
+            outputExtension = ".png";
+        } else if (token.compare("--output-tif") == 0) {
+            outputExtension = ".tif";
+        } else if (token.compare("--output-ppm") == 0) {
+            outputExtension = ".ppm";
+        } else if (token.compare("--output-exr") == 0) {
+            outputExtension = ".exr";
+        } else if (token.compare("--bit-depth") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"bit-depth\" expects an integer value following it.");
+            } else {
+                long bitDepth = strtol(argv[i + 1], nullptr, 10);
+                if (bitDepth == 8 || bitDepth == 16) {
+                    saveOptions.bitDepth = int(bitDepth);
+                } else {
+                    warnings.push_back("Parameter \"bit-depth\" has to be either 8 or 16.");
+                }
+                i++;
+            }
+        } else if (token.compare("--exr-float") == 0) {
+            saveOptions.exrHalf = false;
+        } else if (token.compare("--output-pfm") == 0) {
+            outputExtension = ".pfm";
+        } else if (token.compare("--output-raw") == 0) {
+            outputExtension = ".raw";
+        } else if (token.compare("--raw-size") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"raw-size\" expects a resolution following it.");
+            } else {
+                unsigned long width, height;
+                if (sscanf(argv[i + 1], "%lux%lu", &width, &height) == 2 && width > 0 && height > 0) {
+                    rawWidth  = size_t(width);
+                    rawHeight = size_t(height);
+                } else {
+                    warnings.push_back("Parameter \"raw-size\" expects a resolution such as \"1920x1080\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--raw-half") == 0) {
+            rawHalf = true;
+        } else if (token.compare("--stdout") == 0) {
+            writeToStdout = true;
+            openGUI = false;
+        } else if (token.compare("-") == 0) {
+            // Standard input
+            inputImages.push_back(token);
+            openGUI = false;
+        } else if (token.compare("--dither") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"dither\" expects a string following it.");
+            } else {
+                std::string dither = argv[i + 1];
+                if (dither == "none") {
+                    saveOptions.dither = Dither::None;
+                } else if (dither == "ordered") {
+                    saveOptions.dither = Dither::Ordered;
+                } else if (dither == "blue-noise") {
+                    saveOptions.dither = Dither::BlueNoise;
+                } else {
+                    warnings.push_back("Unknown dithering \"" + dither + "\" for parameter \"dither\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--png-compression") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"png-compression\" expects an integer value following it.");
+            } else {
+                saveOptions.pngCompression = int(std::clamp(strtol(argv[i + 1], nullptr, 10), 0l, 9l));
+                i++;
+            }
+        } else if (token.compare("--jpg-quality") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"jpg-quality\" expects an integer value following it.");
+            } else {
+                saveOptions.jpegQuality = int(std::clamp(strtol(argv[i + 1], nullptr, 10), 1l, 100l));
+                i++;
+            }
+        } else if (token.compare("--jpg-subsampling") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"jpg-subsampling\" expects a string following it.");
+            } else {
+                std::string subsampling = argv[i + 1];
+                if (subsampling == "444") {
+                    saveOptions.jpegSubsampling = ChromaSubsampling::Chroma444;
+                } else if (subsampling == "422") {
+                    saveOptions.jpegSubsampling = ChromaSubsampling::Chroma422;
+                } else if (subsampling == "420") {
+                    saveOptions.jpegSubsampling = ChromaSubsampling::Chroma420;
+                } else {
+                    warnings.push_back("Unknown chroma subsampling \"" + subsampling + "\" for parameter \"jpg-subsampling\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--threads") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"threads\" expects an integer value following it.");
+            } else {
+                threadCount = size_t(std::max(0l, strtol(argv[i + 1], nullptr, 10)));
+                i++;
+            }
+        } else if (token.compare("--tile-size") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"tile-size\" expects an integer value following it.");
+            } else {
+                tileSize = size_t(std::max(1l, strtol(argv[i + 1], nullptr, 10)));
+                i++;
+            }
+        } else if (token.compare("--jobs") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"jobs\" expects an integer value following it.");
+            } else {
+                jobCount = size_t(std::max(0l, strtol(argv[i + 1], nullptr, 10)));
+                i++;
+            }
+        } else if (token.compare("--memory-budget") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"memory-budget\" expects an integer value following it.");
+            } else {
+                memoryBudget = size_t(std::max(0l, strtol(argv[i + 1], nullptr, 10)));
+                i++;
+            }
+        } else if (token.compare("--deterministic") == 0) {
+            deterministic = true;
+        } else if (token.compare("--layout") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"layout\" expects a string following it.");
+            } else {
+                std::string layoutName = argv[i + 1];
+                if (layoutName == "planar") {
+                    layout = PixelLayout::Planar;
+                } else if (layoutName == "interleaved") {
+                    layout = PixelLayout::Interleaved;
+                } else if (layoutName == "half") {
+                    layout = PixelLayout::PlanarHalf;
+                } else {
+                    warnings.push_back("Unknown layout \"" + layoutName + "\" for parameter \"layout\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--part") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"part\" expects a string following it.");
+            } else {
+                exrPart = argv[i + 1];
+                i++;
+            }
+        } else if (token.compare("--channels") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"channels\" expects a string following it.");
+            } else {
+                exrChannels = argv[i + 1];
+                i++;
+            }
+        } else if (token.compare("--display-window") == 0) {
+            displayWindow = true;
+        } else if (token.compare("--roi") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"roi\" expects a region following it.");
+            } else {
+                unsigned long x, y, width, height;
+                if (sscanf(argv[i + 1], "%lu,%lu,%lu,%lu", &x, &y, &width, &height) == 4) {
+                    roi[0] = size_t(x);
+                    roi[1] = size_t(y);
+                    roi[2] = size_t(width);
+                    roi[3] = size_t(height);
+                } else {
+                    warnings.push_back("Parameter \"roi\" expects a region such as \"0,0,1920,1080\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--downsample") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"downsample\" expects an integer value following it.");
+            } else {
+                downsample = size_t(std::max(1l, strtol(argv[i + 1], nullptr, 10)));
+                i++;
+            }
+        } else if (token.compare("--simd") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"simd\" expects a string following it.");
+            } else {
+                if (!parseSimdLevel(argv[i + 1], simdLevel)) {
+                    warnings.push_back("Unknown instruction set \"" + std::string(argv[i + 1]) + "\" for parameter \"simd\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--lut-size") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"lut-size\" expects a size following it.");
+            } else {
+                unsigned long curveSize, cubeSize;
+                int count = sscanf(argv[i + 1], "%lu,%lu", &curveSize, &cubeSize);
+                if (count >= 1 && curveSize >= 3 && (count == 1 || cubeSize >= 3)) {
+                    lutSize[0] = size_t(curveSize);
+                    if (count == 2) lutSize[1] = size_t(cubeSize);
+                } else {
+                    warnings.push_back("Parameter \"lut-size\" expects sizes of at least 3 such as \"4096,65\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--exact") == 0) {
+            exact = true;
+        } else if (token.compare("--export-lut") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"export-lut\" expects a filename following it.");
+            } else {
+                lutFilename = argv[i + 1];
+                std::string lutExtension = std::filesystem::path(lutFilename).extension().string();
+                if (lutExtension != ".cube" && lutExtension != ".spi1d" && lutExtension != ".clf") {
+                    warnings.push_back("Parameter \"export-lut\" expects a \".cube\", \".spi1d\", or \".clf\" file.");
+                }
+                openGUI = false;
+                i++;
+            }
+        } else if (token.compare("--lut-shaper") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"lut-shaper\" expects a string following it.");
+            } else {
+                std::string shaper = argv[i + 1];
+                if (shaper == "linear") {
+                    lutOptions.shaper = LutShaperType::Linear;
+                } else if (shaper == "log2") {
+                    lutOptions.shaper = LutShaperType::Log2;
+                } else {
+                    warnings.push_back("Unknown shaper \"" + shaper + "\" for parameter \"lut-shaper\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--lut-range") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"lut-range\" expects a range following it.");
+            } else {
+                float minimum, maximum;
+                int count = sscanf(argv[i + 1], "%f,%f", &minimum, &maximum);
+                if (count == 1 && minimum > 0.f) {
+                    lutOptions.maximum = minimum;
+                    lutRangeGiven = true;
+                } else if (count == 2 && minimum > 0.f && maximum > minimum) {
+                    lutOptions.minimum = minimum;
+                    lutOptions.maximum = maximum;
+                    lutRangeGiven = true;
+                } else {
+                    warnings.push_back("Parameter \"lut-range\" expects a positive range such as \"64\" or \"0.001,64\".");
+                }
+                i++;
+            }
+        } else if (token.compare("--pack-rf") == 0) {
+            if (i + 1 >= argc) {
+                warnings.push_back("Parameter \"pack-rf\" expects a filename following it.");
+            } else {
+                packFilename = argv[i + 1];
+                openGUI = false;
+                i++;
+            }
         } else if (token.compare("--operator") == 0) {
             // Determine which operator should be used
             if (i + 1 >= argc) {
@@ -177,7 +616,9 @@ int main(int argc, char **argv) {
             }
 
         } else if (extension.compare(".exr") == 0 ||
-                   extension.compare(".hdr") == 0) {
+                   extension.compare(".hdr") == 0 ||
+                   extension.compare(".pfm") == 0 ||
+                   extension.compare(".raw") == 0) {
             if (std::filesystem::exists(token)) {
                 inputImages.push_back(token);
             } else {
@@ -218,11 +659,70 @@ int main(int argc, char **argv) {
     }
 #endif
 
+    if (!packFilename.empty()) {
+        // The remaining arguments are the files to pack
+        std::vector<std::string> files;
+        for (const std::string &token : additionalTokens) {
+            if (std::filesystem::is_directory(token)) {
+                for (auto const &entry : std::filesystem::directory_iterator(token)) {
+                    if (entry.path().extension() == ".rf") {
+                        files.push_back(entry.path().string());
+                    }
+                }
+            } else {
+                files.push_back(token);
+            }
+        }
+        std::sort(files.begin(), files.end());
+
+        PRINT("");
+        std::vector<ResponseFunction> functions;
+        for (const std::string &file : files) {
+            ResponseFunction rf;
+            if (!readResponseFunction(file, rf) || rf.irradiance.size() < 2) {
+                WARN("Could not read response function file \"%s\".", file);
+                PRINT("");
+                return -1;
+            }
+            rf.name = std::filesystem::path(file).stem().string();
+            functions.push_back(std::move(rf));
+        }
+        if (functions.empty()) {
+            WARN("Parameter \"pack-rf\" needs at least one response function file.");
+            PRINT("");
+            return -1;
+        }
+
+        try {
+            PRINT_("* Pack %d response functions into \"%s\" .. ", functions.size(), packFilename);
+            ResponseFunctionPack::write(packFilename, functions);
+            PRINT("done.");
+        } catch (const std::exception &e) {
+            PRINT("%s", e.what());
+            return -1;
+        }
+        PRINT("");
+        return 0;
+    }
+
     if (!tm) {
         warnings.push_back("Need to specify one tonemapping operator via the \"operator\" option.");
     }
-    if (inputImages.size() == 0) {
-        warnings.push_back("Need to specify at least one (.exr or .hdr) input image.");
+    if (lutFilename.empty() && inputImages.size() == 0) {
+        warnings.push_back("Need to specify at least one (.exr, .hdr, .pfm or .raw) input image.");
+    }
+    if (!lutFilename.empty() && inputImages.size() > 1) {
+        warnings.push_back("Parameter \"export-lut\" takes at most one input image.");
+    }
+    if (!lutFilename.empty() && inputImages.size() == 0 && tm &&
+        (tm->traits.needsStatistics || exposureMode != ExposureMode::Value)) {
+        warnings.push_back("Parameter \"export-lut\" needs an input image for the image statistics used by the operator or exposure.");
+    }
+    if (writeToStdout && inputImages.size() > 1) {
+        warnings.push_back("Parameter \"stdout\" needs exactly one input image.");
+    }
+    if (std::count(inputImages.begin(), inputImages.end(), "-") > 1) {
+        warnings.push_back("Standard input (\"-\") can only be read once.");
     }
 
     if (tm) {
@@ -254,6 +754,9 @@ int main(int argc, char **argv) {
                 }
             }
         }
+        if (!tm->traits.needsStatistics) {
+            tm->updateParameters();
+        }
     }
 
     if (tm && tm->dataDriven && rfFilename.compare("") == 0) {
@@ -283,7 +786,20 @@ int main(int argc, char **argv) {
     }
     PRINT("");
 
+    ThreadPool::get().setThreadCount(threadCount);
+    ThreadPool::get().setDeterministic(deterministic);
+
+    if (!isSimdLevelSupported(simdLevel)) {
+        WARN("Instruction set \"%s\" is not supported on this system, using \"%s\" instead.",
+             simdLevelName(simdLevel), simdLevelName(detectSimdLevel()));
+        PRINT("");
+        simdLevel = detectSimdLevel();
+    }
+    setSimdLevel(simdLevel);
+
     if (tm) {
+        tm->tileSize = tileSize;
+
         PRINT("* Chosen operator: \"%s\"", tm->name);
         PRINT("* Parameters:");
         size_t maxLength = 0;
@@ -306,12 +822,25 @@ int main(int argc, char **argv) {
         PRINT("");
     }
 
-    for (size_t i = 0; i < inputImages.size(); ++i) {
-        PRINT_("* Read \"%s\" .. ", inputImages[i]);
-        Image *img = Image::load(inputImages[i]);
-        PRINT("done.");
-        tm->preprocess(img);
+    LoadOptions loadOptions;
+    loadOptions.layout    = layout;
+    loadOptions.part      = exrPart;
+    loadOptions.channels  = exrChannels;
+    loadOptions.displayWindow = displayWindow;
+    loadOptions.rawWidth  = rawWidth;
+    loadOptions.rawHeight = rawHeight;
+    loadOptions.rawHalf   = rawHalf;
+    loadOptions.roiX      = roi[0];
+    loadOptions.roiY      = roi[1];
+    loadOptions.roiWidth  = roi[2];
+    loadOptions.roiHeight = roi[3];
+    loadOptions.downsample = downsample;
+    saveOptions.rawHalf   = rawHalf;
+    if (writeToStdout) {
+        saveOptions.format = outputExtension;
+    }
 
+    auto computeExposure = [&](const Image *img) {
         float exposure = 1.f;
         if (exposureMode == ExposureMode::Value) {
             exposure = std::pow(2.f, exposureInput);
@@ -325,31 +854,147 @@ int main(int argc, char **argv) {
             float alpha = 1.03f - 2.f / (2.f + std::log10(img->getLogMeanLuminance() + 1.f));
             exposure = alpha / img->getLogMeanLuminance();
         }
+        return exposure;
+    };
+
+    if (!lutFilename.empty()) {
+        int result = 0;
+        try {
+            std::unique_ptr<Image> img;
+            if (inputImages.size() > 0) {
+                PRINT_("* Read \"%s\" .. ", inputImages[0]);
+                img.reset(Image::load(inputImages[0], loadOptions));
+                if (!img) {
+                    ERROR("Could not read \"%s\".", inputImages[0]);
+                }
+                PRINT("done.");
+            }
 
-        Image *out = new Image(img->getWidth(), img->getHeight());
-           
-        if (tm) {
-            PRINT_("  Processing %d x %d pixels, exposure = %.2f .. ", img->getWidth(), img->getHeight(), exposure);
-            tm->process(img, out, exposure);
-            PRINT("done.");
+            const TonemapOperator *op = tm;
+            std::unique_ptr<TonemapOperator> owned;
+            if (tm->traits.needsStatistics) {
+                owned.reset(TonemapOperator::clone(operatorKey, tm));
+                owned->preprocess(img.get());
+                owned->updateParameters();
+                op = owned.get();
+            }
+            float exposure = img ? computeExposure(img.get()) : std::pow(2.f, exposureInput);
+
+            // By default, the table covers all values of the image
+            if (!lutRangeGiven && img) {
+                Color3f maximum = img->getMaximum();
+                lutOptions.maximum = std::max(maximum[0], std::max(maximum[1], maximum[2]));
+                if (!(lutOptions.maximum > 0.f)) lutOptions.maximum = 1.f;
+            }
+            lutOptions.curveSize = lutSize[0];
+            lutOptions.cubeSize  = lutSize[1];
+
+            PRINT_("* Export \"%s\" for inputs up to %.3f, exposure = %.2f .. ", lutFilename, lutOptions.maximum, exposure);
+            float maxError = exportLut(*op, exposure, lutFilename, lutOptions);
+            PRINT("done, max. error = %.1e", maxError);
+        } catch (const std::exception &e) {
+            PRINT("%s", e.what());
+            result = -1;
         }
-        std::string outname = inputImages[i].substr(0, inputImages[i].size() - 4);
-        if (saveAsJpg) {
-            outname += ".jpg";
-        } else {
-            outname += ".png";
+        PRINT("");
+
+        delete tm;
+        return result;
+    }
+
+    auto outputName = [&](size_t i) {
+        std::string basename = inputImages[i] == "-" ? "stdin" : inputImages[i].substr(0, inputImages[i].size() - 4),
+                    outname  = basename + outputExtension;
+        if (writeToStdout) {
+            outname = "-";
+        } else if (outname == inputImages[i]) {
+            // Never overwrite an input file of the same format
+            outname = basename + "_tonemapped" + outputExtension;
+        }
+        return outname;
+    };
+
+    auto processImage = [&](size_t i, std::ostream &log) {
+        tfm::format(log, "* Read \"%s\" .. ", inputImages[i]);
+        std::unique_ptr<Image> img(Image::load(inputImages[i], loadOptions));
+        if (!img) {
+            ERROR("Could not read \"%s\".", inputImages[i]);
+        }
+        tfm::format(log, "done.\n");
+
+        /* Only operators that read image statistics need their own copy, all
+           others are shared by the images. */
+        const TonemapOperator *op = tm;
+        std::unique_ptr<TonemapOperator> owned;
+        if (tm->traits.needsStatistics) {
+            owned.reset(TonemapOperator::clone(operatorKey, tm));
+            owned->preprocess(img.get());
+            owned->updateParameters();
+            op = owned.get();
         }
-        PRINT_("  Save \"%s\" .. ", outname);
-        out->save(outname);
-        PRINT("done.");
 
+        float exposure = computeExposure(img.get());
+
+        std::string outname = outputName(i);
+
+        /* The tables cover all exposed values of the image. Its maximum is only
+           used if the statistics were computed for the operator or exposure
+           anyway, as the pass over the image would cost more than the tables
+           save. Otherwise, 1D curves can cover all inputs up to where they
+           saturate. Float outputs promise the values without quantization, so
+           they are never approximated. */
+        const OperatorTraits &traits = op->traits;
+        int bitDepth = Image::getBitDepth(outname, saveOptions);
+        float range = 0.f;
+        bool needsSaturation = false;
+        if (lutRangeGiven) {
+            range = exposure * lutOptions.maximum;
+        } else if (traits.needsStatistics || exposureMode != ExposureMode::Value) {
+            Color3f maximum = img->getMaximum();
+            range = exposure * std::max(maximum[0], std::max(maximum[1], maximum[2]));
+        } else if (traits.separable && traits.monotonic && std::isfinite(traits.outputMax)) {
+            range = LutSaturationRange;
+            needsSaturation = true;
+        }
+        if (!exact && bitDepth > 0 && range > 0.f) {
+            std::unique_ptr<BakedOperator> baked(new BakedOperator(*op, exposure, range, lutSize[0], lutSize[1]));
+            switch (baked->getLayout()) {
+            case BakedOperator::Layout::Curves:
+                tfm::format(log, "  Baked 1D curves with %d entries", lutSize[0]);
+                break;
+            case BakedOperator::Layout::Luminance:
+                tfm::format(log, "  Baked luminance and display curves with %d entries", lutSize[0]);
+                break;
+            case BakedOperator::Layout::Cube:
+                tfm::format(log, "  Baked 3D table with %d^3 entries", lutSize[1]);
+                break;
+            }
+            tfm::format(log, ", max. error = %.1e", baked->getMaxError());
+            if (needsSaturation && !baked->isSaturated()) {
+                tfm::format(log, ", curves do not saturate, evaluate exactly instead\n");
+            } else if (baked->getMaxError() <= LutTolerance / float((1 << bitDepth) - 1)) {
+                tfm::format(log, "\n");
+                owned.reset(baked.release());
+                op = owned.get();
+            } else {
+                tfm::format(log, ", evaluate exactly instead\n");
+            }
+        }
 
-        delete img;
-        delete out;
-    }
+        /* Tonemapping and quantization are fused, and float outputs overwrite
+           the input, so no float output image is needed next to it. */
+        tfm::format(log, "  Processing %d x %d pixels, exposure = %.2f, save \"%s\" .. ", img->getWidth(), img->getHeight(), exposure, outname);
+        tonemapToFile(*op, img.get(), exposure, outname, saveOptions);
+        tfm::format(log, "done.\n");
+    };
+
+    BatchScheduler scheduler(jobCount, memoryBudget * 1024 * 1024);
+    size_t failed = scheduler.run(inputImages.size(), [&](size_t i) {
+        return estimateTonemapMemory(inputImages[i], loadOptions, outputName(i), saveOptions);
+    }, processImage);
     delete tm;
 
     PRINT("");
 
-    return 0;
+    return failed > 0 ? -1 : 0;
 }
@@ -39,18 +39,22 @@ public:
                 out_color = vec4(Cout, 1.0);
             }
         )glsl";
-    }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch color
-        Color3f Cin = exposure * color;
+        traits.separable = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
+    }
 
-        // Apply curve directly on color input
-        Color3f Cout = Cin / (Cin + 0.155f) * 1.019f;
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply curve directly on color input
+            auto Cout = Cin / (Cin + 0.155f) * 1.019f;
 
-        /* Gamma correction is already included in the mapping above
-           and only clamping is applied. */
-        return clamp(Cout, 0.f, 1.f);
+            /* Gamma correction is already included in the mapping above
+               and only clamping is applied. */
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
 };
 
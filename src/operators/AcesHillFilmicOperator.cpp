@@ -26,14 +26,14 @@ public:
             uniform float gamma;
 
             vec3 mulInput(vec3 color) {
-                float a = 0.59719 * color.r + 0.35458 * color.g + 0.04823 * color.b,
+                auto a = 0.59719 * color.r + 0.35458 * color.g + 0.04823 * color.b,
                       b = 0.07600 * color.r + 0.90834 * color.g + 0.01566 * color.b,
                       c = 0.02840 * color.r + 0.13383 * color.g + 0.83777 * color.b;
                 return vec3(a, b, c);
             }
 
             vec3 mulOutput(vec3 color) {
-                float a =  1.60475 * color.r - 0.53108 * color.g - 0.07367 * color.b,
+                auto a =  1.60475 * color.r - 0.53108 * color.g - 0.07367 * color.b,
                       b = -0.10208 * color.r + 1.10813 * color.g - 0.00605 * color.b,
                       c = -0.00327 * color.r - 0.07276 * color.g + 1.07602 * color.b;
                 return vec3(a, b, c);
@@ -58,40 +58,54 @@ public:
         )glsl";
 
         parameters["gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value.");
+
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
+    }
+
+    struct Params {
+        float invGamma;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        return p;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        auto mulInput = [](const Color3f &color) {
-            float a = 0.59719f * color.r() + 0.35458f * color.g() + 0.04823f * color.b(),
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        auto mulInput = [](auto color) TONEMAPPER_SIMD_KERNEL {
+            auto a = 0.59719f * color.r() + 0.35458f * color.g() + 0.04823f * color.b(),
                   b = 0.07600f * color.r() + 0.90834f * color.g() + 0.01566f * color.b(),
                   c = 0.02840f * color.r() + 0.13383f * color.g() + 0.83777f * color.b();
-            return Color3f(a, b, c);
+            return decltype(color)(a, b, c);
         };
 
-        auto mulOutput = [](const Color3f &color) {
-            float a =  1.60475f * color.r() - 0.53108f * color.g() - 0.07367f * color.b(),
+        auto mulOutput = [](auto color) TONEMAPPER_SIMD_KERNEL {
+            auto a =  1.60475f * color.r() - 0.53108f * color.g() - 0.07367f * color.b(),
                   b = -0.10208f * color.r() + 1.10813f * color.g() - 0.00605f * color.b(),
                   c = -0.00327f * color.r() - 0.07276f * color.g() + 1.07602f * color.b();
-            return Color3f(a, b, c);
+            return decltype(color)(a, b, c);
         };
 
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value;
-
-        // Fetch color
-        Color3f Cin = exposure * color;
+        const Params &p = m_params.get();
 
-        // Apply curve directly on color input
-        Cin = mulInput(Cin);
-        Color3f a    = Cin * (Cin + 0.0245786f) - 0.000090537f,
-                b    = Cin * (0.983729f * Cin + 0.4329510f) + 0.238081f,
-                Cout = a / b;
-        Cout = mulOutput(Cout);
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply curve directly on color input
+            Cin = mulInput(Cin);
+            auto a    = Cin * (Cin + 0.0245786f) - 0.000090537f,
+                 b    = Cin * (0.983729f * Cin + 0.4329510f) + 0.238081f,
+                 Cout = a / b;
+            Cout = mulOutput(Cout);
 
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(AcesHillFilmicOperator, "aces_hill");
@@ -43,24 +43,44 @@ public:
         )glsl";
 
         parameters["cutoff"] = Parameter(0.025f, 0.f, 0.5f, "cutoff", "Transition into compressed blacks.");
+
+        traits.separable = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float cutoff = parameters.at("cutoff").value;
+    struct Params {
+        float cutoff;
+        float blackScale;   // 0.25 / cutoff
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.cutoff     = parameters.at("cutoff").value;
+        p.blackScale = 0.25f / p.cutoff;
+        return p;
+    }
 
-        // Fetch color
-        Color3f Cin = exposure * color;
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
 
-        // Apply curve directly on color input
-        Color3f tmp  = Color3f(2.f * cutoff),
-                x    = Cin + (tmp - Cin) * clamp(tmp - Cin, 0.f, 1.f) * (0.25f / cutoff) - cutoff,
-                Cout = (x * (6.2f * x + 0.5f)) / (x * (6.2f * x + 1.7f) + 0.06f);
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            typedef decltype(Cin) Color;
 
-        /* Gamma correction is already included in the mapping above
-           and only clamping is applied. */
-        return clamp(Cout, 0.f, 1.f);
+            // Apply curve directly on color input
+            Color tmp  = Color(2.f * p.cutoff),
+                  x    = Cin + (tmp - Cin) * clamp(tmp - Cin, 0.f, 1.f) * p.blackScale - p.cutoff,
+                  Cout = (x * (6.2f * x + 0.5f)) / (x * (6.2f * x + 1.7f) + 0.06f);
+
+            /* Gamma correction is already included in the mapping above
+               and only clamping is applied. */
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(AldridgeFilmicOperator, "aldridge");
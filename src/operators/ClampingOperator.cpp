@@ -54,6 +54,12 @@ public:
 
         parameters["gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value.");
         parameters["Lwhite"] = Parameter(std::numeric_limits<float>::infinity(), 0.f, 0.f, "Lwhite", "Smallest luminance that is mapped to 1.");
+
+        traits.luminanceScaled = true;
+        traits.needsStatistics = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
@@ -67,29 +73,53 @@ public:
         }
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma  = parameters.at("gamma").value,
-              Lwhite = parameters.at("Lwhite").value;
-        // VARLOG2(gamma, Lwhite);
+    struct Params {
+        float invGamma;
+        float Lwhite;
+    };
 
-        // Fetch color and convert to luminance
-        Color3f Cin = exposure * color;
-        float Lin = luminance(Cin);
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.Lwhite   = parameters.at("Lwhite").value;
+        return p;
+    }
 
+    static auto luminanceCurve(const Params &p, float exposure) {
         // Apply exposure scale to parameters
-        Lwhite *= exposure;
+        float Lwhite = p.Lwhite * exposure;
+
+        return [=](auto Lin) TONEMAPPER_SIMD_KERNEL {
+            return simd::clamp(Lin / Lwhite, 0.f, 1.f);
+        };
+    }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+        auto curve = luminanceCurve(p, exposure);
 
-        // Apply tonemapping curve to luminance
-        float Lout = std::clamp(Lin / Lwhite, 0.f, 1.f);
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Convert to luminance
+            auto Lin = luminance(Cin);
 
-        // Treat color by preserving color ratios [Schlick 1994].
-        Color3f Cout = Cin / Lin * Lout;
+            // Apply tonemapping curve to luminance
+            auto Lout = curve(Lin);
 
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+            // Treat color by preserving color ratios [Schlick 1994].
+            auto Cout = Cin / Lin * Lout;
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
+    }
+
+    float mapLuminance(float L, float exposure) const override {
+        return luminanceCurve(m_params.get(), exposure)(L);
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(ClampingOperator, "clamping");
@@ -62,42 +62,60 @@ public:
         parameters["t"]     = Parameter(0.7f, 0.f, 1.f,  "t",     "Toe strength. Amount of blending between a straight-line curve and a purely asymptotic curve for the toe.");
         parameters["s"]     = Parameter(0.8f, 0.f, 1.f,  "s",     "Shoulder strength. Amount of blending between a straight-line curve and a purely asymptotic curve for the shoulder.");
         parameters["c"]     = Parameter(2.f,  0.f, 10.f, "c",     "Cross-over point. Point where the toe and shoulder are pieced together into a single curve.");
+
+        traits.separable = true;
+        traits.needsStatistics = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
         parameters["Lavg"] = Parameter(image->getMeanLuminance(), "Lavg");
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value,
-              w     = parameters.at("w").value,
-              b     = parameters.at("b").value,
-              t     = parameters.at("t").value,
-              s     = parameters.at("s").value,
-              c     = parameters.at("c").value,
-              Lavg  = parameters.at("Lavg").value;
-
-        auto curve = [w, b, t, s, c](float x, float k) {
-            if (x < c) {
-                return k * (1.f - t) * (x - b) / (c - (1.f - t) * b - t * x);
-            } else {
-                return (1.f - k) * (x - c) / (s * x + (1.f - s) * w - c) + k;
-            }
-        };
+    struct Params {
+        float invGamma;
+        float w, b, t, s, c;
+        float k;        // Blend weight between toe and shoulder at the cross-over point
+        float Lavg;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.w        = parameters.at("w").value;
+        p.b        = parameters.at("b").value;
+        p.t        = parameters.at("t").value;
+        p.s        = parameters.at("s").value;
+        p.c        = parameters.at("c").value;
+        p.Lavg     = parameters.at("Lavg").value;
+        p.k        = (1.f - p.t) * (p.c - p.b) / ((1.f - p.s) * (p.w - p.c) + (1.f - p.t) * (p.c - p.b));
+        return p;
+    }
 
-        // Fetch color
-        Color3f Cin = exposure * color;
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
 
-        // Apply curve directly on color input
-        Color3f Cout = Cin / Lavg;
-        float k = (1.f - t) * (c - b) / ((1.f - s) * (w - c) + (1.f - t) * (c - b));
-        Cout = Color3f(curve(Cout.r(), k), curve(Cout.g(), k), curve(Cout.b(), k));
+        auto curve = [&p](auto x) TONEMAPPER_SIMD_KERNEL {
+            return simd::select(x < p.c,
+                                p.k * (1.f - p.t) * (x - p.b) / (p.c - (1.f - p.t) * p.b - p.t * x),
+                                (1.f - p.k) * (x - p.c) / (p.s * x + (1.f - p.s) * p.w - p.c) + p.k);
+        };
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply curve directly on color input
+            auto Cout = Cin / p.Lavg;
+            Cout = decltype(Cin)(curve(Cout.r()), curve(Cout.g()), curve(Cout.b()));
 
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(DayFilmicOperator, "day");
@@ -81,6 +81,11 @@ public:
         parameters["b"]     = Parameter(0.85f,  0.f, 1.f,   "b",     "Bias function parameter");
         parameters["slope"] = Parameter(4.5f,   0.f, 10.f,  "slope", "Elevation ratio of the line passing by the origin and tangent to the curve (for custom gamma correction).");
         parameters["start"] = Parameter(0.018f, 0.f, 1.f,   "start", "Abscissa at the point of tangency (for custom gamma correction).");
+
+        traits.luminanceScaled = true;
+        traits.needsStatistics = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
@@ -89,49 +94,87 @@ public:
         parameters["Lmax"] = Parameter(image->getMaximumLuminance(), "Lmax");
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
+    struct Params {
+        float Ldmax;
+        float Lmax;
+        float LwaP;             // Biased world adaptation
+        float exponent;         // Bias power function exponent
+        float slope, start;     // Custom gamma curve
+        float gammaExponent;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
         float gamma = parameters.at("gamma").value,
-              Ldmax = parameters.at("Ldmax").value,
               Lwa   = parameters.at("Lwa").value,
-              Lmax  = parameters.at("Lmax").value,
-              b     = parameters.at("b").value,
-              slope = parameters.at("slope").value,
-              start = parameters.at("start").value;
-
-        auto customGamma = [start, slope, gamma](float C) {
-            if (C <= start) {
-                return slope * C;
-            } else {
-                return std::pow(1.099f * C, 0.9f / gamma) - 0.099f;
-            }
-        };
+              b     = parameters.at("b").value;
 
-        // Fetch color and convert to luminance
-        Color3f Cin = exposure * color;
-        float Lin = luminance(Cin);
+        p.Ldmax         = parameters.at("Ldmax").value;
+        p.Lmax          = parameters.at("Lmax").value;
+        p.slope         = parameters.at("slope").value;
+        p.start         = parameters.at("start").value;
+        p.gammaExponent = 0.9f / gamma;
+
+        // Bias the world adaptation and scale other parameters accordingly
+        p.LwaP     = Lwa / std::pow(1.f + b - 0.85f, 5.f);
+        p.exponent = std::log(b) / std::log(0.5f);
+        return p;
+    }
 
+    static auto luminanceCurve(const Params &p, float exposure) {
         // Apply exposure scale to parameters
-        Lmax *= exposure;
+        float Lmax  = p.Lmax * exposure,
+              LmaxP = Lmax / p.LwaP,
+              c1    = (0.01f * p.Ldmax) / std::log10(1.f + LmaxP);
+
+        return [=](auto Lin) TONEMAPPER_SIMD_KERNEL {
+            auto LinP = Lin / p.LwaP,
+                 c2   = simd::log(1.f + LinP) / simd::log(2.f + 8.f * simd::pow(LinP / LmaxP, p.exponent));
+            return c1 * c2;
+        };
+    }
 
-        // Bias the world adaptation and scale other parameters accordingly
-        float LwaP  = Lwa / std::pow(1.f + b - 0.85f, 5.f),
-              LmaxP = Lmax / LwaP,
-              LinP  = Lin / LwaP;
-
-        // Apply tonemapping curve to luminance
-        float exponent = std::log(b) / std::log(0.5f),
-              c1       = (0.01f * Ldmax) / std::log10(1.f + LmaxP),
-              c2       = std::log(1.f + LinP) / std::log(2.f + 8.f * std::pow(LinP / LmaxP, exponent)),
-              Lout     = c1 * c2;
-
-        // Treat color by preserving color ratios [Schlick 1994].
-        Color3f Cout = Cin / Lin * Lout;
-
-        // Apply gamma curve and clamp
-        Cout = Color3f(customGamma(Cout.r()), customGamma(Cout.g()), customGamma(Cout.b()));
-        return clamp(Cout, 0.f, 1.f);
+    // Custom gamma curve, shared by `mapSpan` and `mapDisplay`
+    static auto displayCurve(const Params &p) {
+        return [=](auto C) TONEMAPPER_SIMD_KERNEL {
+            return simd::select(C <= p.start,
+                                p.slope * C,
+                                simd::pow(1.099f * C, p.gammaExponent) - 0.099f);
+        };
+    }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+
+        auto customGamma = displayCurve(p);
+        auto curve = luminanceCurve(p, exposure);
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Convert to luminance
+            auto Lin = luminance(Cin);
+
+            // Apply tonemapping curve to luminance
+            auto Lout = curve(Lin);
+
+            // Treat color by preserving color ratios [Schlick 1994].
+            auto Cout = Cin / Lin * Lout;
+
+            // Apply gamma curve and clamp
+            Cout = decltype(Cin)(customGamma(Cout.r()), customGamma(Cout.g()), customGamma(Cout.b()));
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+    float mapLuminance(float L, float exposure) const override {
+        return luminanceCurve(m_params.get(), exposure)(L);
+    }
+
+    float mapDisplay(float x) const override {
+        return simd::clamp(displayCurve(m_params.get())(x), 0.f, 1.f);
+    }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(DragoOperator, "drago");
@@ -96,6 +96,10 @@ public:
 
         parameters["gamma"] = Parameter(2.2f, 0.f, 10.f,  "gamma", "Gamma correction value.");
         parameters["Ldmax"] = Parameter(80.f, 1.f, 150.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)");
+
+        traits.needsStatistics = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
@@ -112,7 +116,15 @@ public:
         parameters["k"] = Parameter(k, 0.f, 1.f, "k", "Blend between photopic and scotopic world adaption to account for mesopic range in between.");
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
+    struct Params {
+        float invGamma;
+        float Ldmax;
+        float mp;           // Cone scale factor
+        Color3f rodScale;   // Rod scale factor including mesopic blend and blue shift
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
         auto tp = [](float La) {
             // Photopic threshold (for cones)
             float logLa = std::log10(La);
@@ -141,28 +153,41 @@ public:
             return std::pow(10.f, result);
         };
 
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value,
-              Ldmax = parameters.at("Ldmax").value,
-              Lwap  = parameters.at("Lwap").value,
-              Lwas  = parameters.at("Lwas").value,
-              k     = parameters.at("k").value;
-
-        // Fetch color
-        Color3f Cin = exposure * color;
-
-        // Apply tonemapping curve directly to RGB (cone) and rod signal
-        float Lda = 0.5f * Ldmax,
-              Ls = luminanceRods(Cin),
-              mp = tp(Lda) / tp(Lwap),
-              ms = tp(Lda) / ts(Lwas);
+        float Lwap = parameters.at("Lwap").value,
+              Lwas = parameters.at("Lwas").value,
+              k    = parameters.at("k").value;
+
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.Ldmax    = parameters.at("Ldmax").value;
+
+        // Cone and rod scale factors only depend on the adaptation levels
+        float Lda = 0.5f * p.Ldmax,
+              ms  = tp(Lda) / ts(Lwas);
+        p.mp = tp(Lda) / tp(Lwap);
+
         Color3f blueShift = Color3f(0.105f, 0.97f, 1.27f);
-        Color3f Cout = (mp * Cin + blueShift * k * ms * Color3f(Ls)) / Ldmax;
+        p.rodScale = blueShift * k * ms;
+        return p;
+    }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            typedef decltype(Cin) Color;
 
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+            // Apply tonemapping curve directly to RGB (cone) and rod signal
+            auto Ls = luminanceRods(Cin);
+            Color Cout = (p.mp * Cin + Color(p.rodScale) * Color(Ls)) / p.Ldmax;
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(DurandDorseyOperator, "durand_dorsey");
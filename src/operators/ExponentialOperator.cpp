@@ -53,34 +53,65 @@ public:
         )glsl";
 
         parameters["gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value.");
+
+        traits.luminanceScaled = true;
+        traits.needsStatistics = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
         parameters["Lavg"] = Parameter(image->getMeanLuminance(), "Lavg");
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value,
-              Lavg  = parameters.at("Lavg").value;
+    struct Params {
+        float invGamma;
+        float Lavg;
+    };
 
-        // Fetch color and convert to luminance
-        Color3f Cin = exposure * color;
-        float Lin = luminance(Cin);
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.Lavg     = parameters.at("Lavg").value;
+        return p;
+    }
 
+    static auto luminanceCurve(const Params &p, float exposure) {
         // Apply exposure scale to parameters
-        Lavg *= exposure;
+        float Lavg = p.Lavg * exposure;
+
+        return [=](auto Lin) TONEMAPPER_SIMD_KERNEL {
+            return 1.f - simd::exp(-Lin / Lavg);
+        };
+    }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+        auto curve = luminanceCurve(p, exposure);
 
-        // Apply tonemapping curve to luminance
-        float Lout = 1.f - std::exp(-Lin / Lavg);
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Convert to luminance
+            auto Lin = luminance(Cin);
 
-        // Treat color by preserving color ratios [Schlick 1994].
-        Color3f Cout = Cin / Lin * Lout;
+            // Apply tonemapping curve to luminance
+            auto Lout = curve(Lin);
 
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+            // Treat color by preserving color ratios [Schlick 1994].
+            auto Cout = Cin / Lin * Lout;
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
+    }
+
+    float mapLuminance(float L, float exposure) const override {
+        return luminanceCurve(m_params.get(), exposure)(L);
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(ExponentialOperator, "exponential");
@@ -55,35 +55,67 @@ public:
 
         parameters["gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value.");
         parameters["p"]     = Parameter(0.5f, 0.f, 1.f,  "p",     "Curve exponent parameter");
+
+        traits.luminanceScaled = true;
+        traits.needsStatistics = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
         parameters["Lmax"] = Parameter(image->getMaximumLuminance(), "Lmax");
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value,
-              p     = parameters.at("p").value,
-              Lmax  = parameters.at("Lmax").value;
-
-        // Fetch color and convert to luminance
-        Color3f Cin = exposure * color;
-        float Lin = luminance(Cin);
+    struct Params {
+        float invGamma;
+        float p;
+        float Lmax;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.p        = parameters.at("p").value;
+        p.Lmax     = parameters.at("Lmax").value;
+        return p;
+    }
 
+    static auto luminanceCurve(const Params &p, float exposure) {
         // Apply exposure scale to parameters
-        Lmax *= exposure;
+        float Lmax = p.Lmax * exposure;
+
+        return [=](auto Lin) TONEMAPPER_SIMD_KERNEL {
+            return simd::pow(Lin / Lmax, p.p);
+        };
+    }
 
-        // Apply tonemapping curve to luminance
-        float Lout = std::pow(Lin / Lmax, p);
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+        auto curve = luminanceCurve(p, exposure);
 
-        // Treat color by preserving color ratios [Schlick 1994].
-        Color3f Cout = Cin / Lin * Lout;
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Convert to luminance
+            auto Lin = luminance(Cin);
 
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+            // Apply tonemapping curve to luminance
+            auto Lout = curve(Lin);
+
+            // Treat color by preserving color ratios [Schlick 1994].
+            auto Cout = Cin / Lin * Lout;
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+    float mapLuminance(float L, float exposure) const override {
+        return luminanceCurve(m_params.get(), exposure)(L);
+    }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(ExponentiationOperator, "exponentiation");
@@ -37,19 +37,35 @@ public:
         )glsl";
 
         parameters["gamma"] = Parameter(2.2f, 0.f, 10.f, "gamma", "Gamma correction value.");
+
+        traits.separable = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value;
+    struct Params {
+        float invGamma;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        return p;
+    }
 
-        // Fetch color
-        Color3f Cin = exposure * color;
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
 
-        // Apply gamma curve and clamp
-        Color3f Cout = pow(Cin, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply gamma curve and clamp
+            auto Cout = pow(Cin, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(GammaOperator, "gamma");
@@ -60,34 +60,53 @@ public:
         parameters["E"]     = Parameter(0.02f, 0.f, 1.f,  "E",     "Toe numerator.");
         parameters["F"]     = Parameter(0.3f,  0.f, 1.f,  "F",     "Toe denominator.");
         parameters["W"]     = Parameter(11.2f, 0.f, 20.f, "W",     "Linear white point value.");
+
+        traits.separable = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value,
-              A     = parameters.at("A").value,
-              B     = parameters.at("B").value,
-              C     = parameters.at("C").value,
-              D     = parameters.at("D").value,
-              E     = parameters.at("E").value,
-              F     = parameters.at("F").value,
-              W     = parameters.at("W").value;
-
-        auto curve = [A, B, C, D, E, F](const Color3f &x) {
-            return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
-        };
-
-        // Fetch color
-        Color3f Cin = exposure * color;
-
-        // Apply curve directly on color input
+    struct Params {
+        float invGamma;
+        float A, B, C, D, E, F;
+        Color3f whiteScale;     // Curve evaluated at the linear white point
+    };
+
+    template <typename Color>
+    static TONEMAPPER_SIMD_INLINE Color curve(const Params &p, const Color &x) {
+        return ((x * (p.A * x + p.C * p.B) + p.D * p.E) / (x * (p.A * x + p.B) + p.D * p.F)) - p.E / p.F;
+    }
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.A        = parameters.at("A").value;
+        p.B        = parameters.at("B").value;
+        p.C        = parameters.at("C").value;
+        p.D        = parameters.at("D").value;
+        p.E        = parameters.at("E").value;
+        p.F        = parameters.at("F").value;
+        p.whiteScale = curve(p, Color3f(parameters.at("W").value));
+        return p;
+    }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+
         float exposureBias = 2.0;
-        Color3f Cout = exposureBias * curve(Cin) / curve(Color3f(W));
 
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply curve directly on color input
+            auto Cout = exposureBias * curve(p, Cin) / decltype(Cin)(p.whiteScale);
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(HableFilmicOperator, "hable");
@@ -181,9 +181,41 @@ public:
         parameters["sStr"]   = Parameter(2.f,  0.f,   10.f,        "sStr",   "Shoulder strength.");
         parameters["sLen"]   = Parameter(0.5f, 1e-5f, 1.f - 1e-5f, "sLen",   "Shoulder length.");
         parameters["sAngle"] = Parameter(1.f,  0.f,   1.f,         "sAngle", "Shoulder angle.");
+
+        traits.separable = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
+    // One power curve segment y = exp(lnA + B * log((x - offsetX) * scaleX)) * scaleY + offsetY
+    struct Segment {
+        float offsetX, offsetY, scaleX, scaleY, lnA, B;
+
+        float eval(float x) const {
+            float x0 = (x - offsetX) * scaleX,
+                  y0 = 0.0;
+            if (x0 > 0.0) {
+                y0 = std::exp(lnA + B * log(x0));
+            }
+            return y0 * scaleY + offsetY;
+        }
+
+        template <typename Float>
+        TONEMAPPER_SIMD_INLINE Float eval(Float x) const {
+            Float x0 = (x - offsetX) * scaleX,
+                  y0 = simd::select(x0 > 0.f, simd::exp(lnA + B * simd::log(x0)), 0.f);
+            return y0 * scaleY + offsetY;
+        }
+    };
+
+    struct Params {
+        float x0, x1;       // Segment boundaries in normalized coordinates
+        float curveWinv;
+        Segment toe, mid, shoulder;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
         auto asSlopeIntercept = [](float x0, float x1, float y0, float y1) {
             float m, b;
             float dy = (y1 - y0),
@@ -207,15 +239,6 @@ public:
             return std::make_pair(lnA, B);
         };
 
-        auto evalCurveSegment = [](float x, float offsetX, float offsetY, float scaleX, float scaleY, float lnA, float B) {
-            float x0 = (x - offsetX) * scaleX,
-                  y0 = 0.0;
-            if (x0 > 0.0) {
-                y0 = std::exp(lnA + B * log(x0));
-            }
-            return y0 * scaleY + offsetY;
-        };
-
         // Fetch parameters
         float gamma  = parameters.at("gamma").value,
               tStr   = parameters.at("tStr").value,
@@ -240,22 +263,25 @@ public:
               invGamma   = 1.f / gamma;
 
         // Precompute information for all three segments (mid, toe, shoulder)
-        float curveWinv = 1.f / W;
+        Params p;
+        p.curveWinv = 1.f / W;
         x0 /= W;
         x1 /= W;
         overshootX /= W;
+        p.x0 = x0;
+        p.x1 = x1;
 
         auto tmp = asSlopeIntercept(x0, x1, y0, y1);
         float m = tmp.first,
               b = tmp.second,
               g = invGamma;
 
-        float midOffsetX = -(b / m),
-              midOffsetY = 0.f,
-              midScaleX  = 1.f,
-              midScaleY  = 1.f,
-              midLnA = g * log(m),
-              midB = g;
+        p.mid.offsetX = -(b / m);
+        p.mid.offsetY = 0.f;
+        p.mid.scaleX  = 1.f;
+        p.mid.scaleY  = 1.f;
+        p.mid.lnA     = g * log(m);
+        p.mid.B       = g;
 
         float toeM      = evalDerivativeLinearGamma(m, b, g, x0),
               shoulderM = evalDerivativeLinearGamma(m, b, g, x1);
@@ -266,68 +292,60 @@ public:
 
         tmp = solveAB(x0, y0, toeM);
 
-        float toeOffsetX = 0.f,
-              toeOffsetY = 0.f,
-              toeScaleX  = 1.f,
-              toeScaleY  = 1.f,
-              toeLnA     = tmp.first,
-              toeB       = tmp.second;
+        p.toe.offsetX = 0.f;
+        p.toe.offsetY = 0.f;
+        p.toe.scaleX  = 1.f;
+        p.toe.scaleY  = 1.f;
+        p.toe.lnA     = tmp.first;
+        p.toe.B       = tmp.second;
 
         float shoulderX0 = (1.f + overshootX) - x1,
               shoulderY0 = (1.f + overshootY) - y1;
         tmp = solveAB(shoulderX0, shoulderY0, shoulderM);
 
-        float shoulderOffsetX =  1.f + overshootX,
-              shoulderOffsetY =  1.f + overshootY,
-              shoulderScaleX  = -1.f,
-              shoulderScaleY  = -1.f,
-              shoulderLnA     = tmp.first,
-              shoulderB       = tmp.second;
+        p.shoulder.offsetX =  1.f + overshootX;
+        p.shoulder.offsetY =  1.f + overshootY;
+        p.shoulder.scaleX  = -1.f;
+        p.shoulder.scaleY  = -1.f;
+        p.shoulder.lnA     = tmp.first;
+        p.shoulder.B       = tmp.second;
 
         // Normalize (correct for overshooting)
-        float scale = evalCurveSegment(1.f,
-                                       shoulderOffsetX, shoulderOffsetY,
-                                       shoulderScaleX, shoulderScaleY,
-                                       shoulderLnA, shoulderB);
-        float invScale = 1.f / scale;
-        toeOffsetY      *= invScale;
-        toeScaleY       *= invScale;
-        midOffsetY      *= invScale;
-        midScaleY       *= invScale;
-        shoulderOffsetY *= invScale;
-        shoulderScaleY  *= invScale;
-
-        // Fetch color
-        Color3f Cin = exposure * color;
-
-        // Apply curve directly on color input
-        Color3f Cout;
-        for (int i = 0; i < 3; ++i) {
-            float normX = Cin[i] * curveWinv;
-            float res;
-            if (normX < x0) {
-                res = evalCurveSegment(normX,
-                                       toeOffsetX, toeOffsetY,
-                                       toeScaleX, toeScaleY,
-                                       toeLnA, toeB);
-            } else if (normX < x1) {
-                res = evalCurveSegment(normX,
-                                       midOffsetX, midOffsetY,
-                                       midScaleX, midScaleY,
-                                       midLnA, midB);
-            } else {
-                res = evalCurveSegment(normX,
-                                       shoulderOffsetX, shoulderOffsetY,
-                                       shoulderScaleX, shoulderScaleY,
-                                       shoulderLnA, shoulderB);
-            }
-            Cout[i] = res;
-        }
+        float scale    = p.shoulder.eval(1.f),
+              invScale = 1.f / scale;
+        p.toe.offsetY      *= invScale;
+        p.toe.scaleY       *= invScale;
+        p.mid.offsetY      *= invScale;
+        p.mid.scaleY       *= invScale;
+        p.shoulder.offsetY *= invScale;
+        p.shoulder.scaleY  *= invScale;
+
+        return p;
+    }
 
-        /* Gamma correction is already included in the mapping above
-           and only clamping is applied. */
-        return clamp(Cout, 0.f, 1.f);
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+
+        auto curve = [&p](auto normX) TONEMAPPER_SIMD_KERNEL {
+            return simd::select(normX < p.x0, p.toe.eval(normX),
+                   simd::select(normX < p.x1, p.mid.eval(normX),
+                                              p.shoulder.eval(normX)));
+        };
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply curve directly on color input
+            auto Cout = decltype(Cin)(curve(Cin.r() * p.curveWinv),
+                                      curve(Cin.g() * p.curveWinv),
+                                      curve(Cin.b() * p.curveWinv));
+
+            /* Gamma correction is already included in the mapping above
+               and only clamping is applied. */
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(HableUpdatedFilmicOperator, "hable_updated");
@@ -39,19 +39,25 @@ public:
                 out_color = vec4(Cout, 1.0);
             }
         )glsl";
+
+        traits.separable = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch color
-        Color3f Cin = exposure * color;
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            typedef decltype(Cin) Color;
 
-        // Apply curve directly on color input
-        Color3f x    = max(Color3f(0.f), Cin - 0.004f),
-                Cout = (x * (6.2f * x + 0.5f)) / (x * (6.2f * x + 1.7f) + 0.06f);
+            // Apply curve directly on color input
+            Color x    = max(Color(0.f), Cin - 0.004f),
+                  Cout = (x * (6.2f * x + 0.5f)) / (x * (6.2f * x + 1.7f) + 0.06f);
 
-        /* Gamma correction is already included in the mapping above
-           and only clamping is applied. */
-        return clamp(Cout, 0.f, 1.f);
+            /* Gamma correction is already included in the mapping above
+               and only clamping is applied. */
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
 };
 
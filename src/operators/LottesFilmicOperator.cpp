@@ -59,33 +59,55 @@ public:
         parameters["hdrMax"]   = Parameter(8.f,    1.f,   10.f, "hdrMax",   "Maximum HDR value.");
         parameters["midIn"]    = Parameter(0.18f,  0.f,   1.f,  "midIn",    "Input mid-level.");
         parameters["midOut"]   = Parameter(0.267f, 0.f,   1.f,  "midOut",   "Output mid-level");
+
+        traits.separable = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma    = parameters.at("gamma").value,
-              contrast = parameters.at("contrast").value,
+    struct Params {
+        float invGamma;
+        float a, ad;    // Contrast, and contrast times shoulder
+        float b, c;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+
+        float contrast = parameters.at("contrast").value,
               shoulder = parameters.at("shoulder").value,
               hdrMax   = parameters.at("hdrMax").value,
               midIn    = parameters.at("midIn").value,
               midOut   = parameters.at("midOut").value;
 
-        // Fetch color
-        Color3f Cin = exposure * color;
-
-        // Apply curve directly on color input
         float a = contrast,
-              d = shoulder,
-              b = (-std::pow(midIn, a) + std::pow(hdrMax, a) * midOut) /
-                  ((std::pow(hdrMax, a * d) - std::pow(midIn, a * d)) * midOut),
-              c = (std::pow(hdrMax, a * d) * std::pow(midIn, a) - std::pow(hdrMax, a) * std::pow(midIn, a * d) * midOut) /
-                  ((std::pow(hdrMax, a * d) - std::pow(midIn, a * d)) * midOut);
-        Color3f Cout = pow(Cin, a) / (pow(Cin, a * d) * b + c);
-
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+              d = shoulder;
+        p.a  = a;
+        p.ad = a * d;
+        p.b  = (-std::pow(midIn, a) + std::pow(hdrMax, a) * midOut) /
+               ((std::pow(hdrMax, a * d) - std::pow(midIn, a * d)) * midOut);
+        p.c  = (std::pow(hdrMax, a * d) * std::pow(midIn, a) - std::pow(hdrMax, a) * std::pow(midIn, a * d) * midOut) /
+               ((std::pow(hdrMax, a * d) - std::pow(midIn, a * d)) * midOut);
+        return p;
     }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply curve directly on color input
+            auto Cout = pow(Cin, p.a) / (pow(Cin, p.ad) * p.b + p.c);
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
+    }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(LottesFilmicOperator, "lottes");
@@ -68,6 +68,10 @@ public:
         parameters["f"]     = Parameter(0.f, -8.f, 8.f,  "f",     "Intensity adjustment parameter.");
         parameters["c"]     = Parameter(0.f,  0.f, 1.f,  "c",     "Chromatic adaptation.");
         parameters["a"]     = Parameter(1.f,  0.f, 1.f,  "a",     "Light adaptation.");
+
+        traits.needsStatistics = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
@@ -85,40 +89,55 @@ public:
         parameters["Lavg"] = Parameter(image->getMeanLuminance(), "Lavg");
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma  = parameters.at("gamma").value,
-              f      = parameters.at("f").value,
-              c      = parameters.at("c").value,
-              a      = parameters.at("a").value,
-              m      = parameters.at("m").value,
-              CmeanR = parameters.at("CmeanR").value,
-              CmeanG = parameters.at("CmeanG").value,
-              CmeanB = parameters.at("CmeanB").value,
-              Lavg   = parameters.at("Lavg").value;
-
-        // Fetch color and convert to luminance
-        Color3f Cin = exposure * color;
+    struct Params {
+        float invGamma;
+        float f;        // Exponentiated intensity adjustment
+        float c, a, m;
+        Color3f Cmean;
+        float Lavg;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.f        = std::exp(-parameters.at("f").value);
+        p.c        = parameters.at("c").value;
+        p.a        = parameters.at("a").value;
+        p.m        = parameters.at("m").value;
+        p.Cmean    = Color3f(parameters.at("CmeanR").value,
+                             parameters.at("CmeanG").value,
+                             parameters.at("CmeanB").value);
+        p.Lavg     = parameters.at("Lavg").value;
+        return p;
+    }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
 
         // Apply exposure scale to parameters
-        Lavg   *= exposure;
-        CmeanR *= exposure;
-        CmeanG *= exposure;
-        CmeanB *= exposure;
-        Color3f Cmean(CmeanR, CmeanG, CmeanB);
-
-        // Apply tonemapping curve, separately for each channel
-        f = std::exp(-f);
-        float    L     = luminance(Cin);
-        Color3f  Il    = c * Cin   + (1.f - c) * L,
-                 Ig    = c * Cmean + (1.f - c) * Lavg,
-                 Ia    = a * Il    + (1.f - c) * Ig,
-                 Cout  = Cin / (Cin + pow(f * Ia, m));
-
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+        float   Lavg  = p.Lavg * exposure;
+        Color3f Cmean = p.Cmean * exposure;
+
+        // Global adaptation only depends on image averages
+        Color3f Ig = p.c * Cmean + (1.f - p.c) * Lavg;
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            typedef decltype(Cin) Color;
+
+            // Apply tonemapping curve, separately for each channel
+            auto  L     = luminance(Cin);
+            Color Il    = p.c * Cin + (1.f - p.c) * L,
+                  Ia    = p.a * Il  + (1.f - p.c) * Color(Ig),
+                  Cout  = Cin / (Cin + pow(p.f * Ia, p.m));
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(ReinhardDevlinOperator, "reinhard_devlin");
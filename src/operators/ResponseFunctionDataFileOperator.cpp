@@ -7,8 +7,11 @@
 
 #include <Tonemap.h>
 
-#include <fstream>
+#include <ResponseFunction.h>
+#include <Simd.h>
+
 #include <filesystem>
+#include <memory>
 
 namespace tonemapper {
 
@@ -50,93 +53,169 @@ public:
         parameters["W"] = Parameter(1.f, 1e-5f, 10.f, "W", "White point.");
 
         dataDriven = true;
+
+        traits.separable = true;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        if (irradiance.size() == 0) {
-            return Color3f(0.f);
+    struct Params {
+        float W;
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.W = parameters.at("W").value;
+        return p;
+    }
+
+    /* The curves resampled to evenly spaced irradiance values, so that a lookup
+       is a multiply and a linear interpolation instead of a binary search. */
+    struct Table {
+        float start, scale;             // Position of irradiance x is (x - start) * scale
+        size_t size;
+        std::vector<float> curves[3];   // Entries and differences to the next ones
+        bool resampled;                 // The file was not evenly spaced already
+    };
+
+    // Entries of tables resampled from unevenly spaced files
+    static constexpr size_t ResampledSize = 4096;
+
+    static std::unique_ptr<const Table> buildTable(const std::vector<float> &irradiance, const std::vector<float> *values) {
+        size_t n = irradiance.size();
+        if (n < 2 || !(irradiance[n - 1] > irradiance[0])) {
+            return nullptr;
         }
+        float first = irradiance[0],
+              step  = (irradiance[n - 1] - first) / float(n - 1);
 
-        auto eval = [this](const Color3f &c) {
-            Color3f result(0.f);
-            for (size_t i = 0; i < 3; ++i) {
-                float x = c[i];
-                if (x < 0.f) {
-                    continue;
-                }
+        // Allow for the rounding of the values in the file
+        bool uniform = true;
+        for (size_t k = 0; k < n && uniform; ++k) {
+            uniform = std::abs(irradiance[k] - (first + float(k) * step)) <= 1e-3f * step;
+        }
 
-                if (x >= 1.f) {
-                    result[i] = 1.f;
+        std::unique_ptr<Table> table(new Table());
+        table->resampled = !uniform;
+        table->size  = uniform ? n : ResampledSize;
+        table->start = first;
+        table->scale = float(table->size - 1) / (irradiance[n - 1] - first);
+        for (size_t ch = 0; ch < 3; ++ch) {
+            std::vector<float> entries(table->size);
+            for (size_t k = 0; k < table->size; ++k) {
+                if (uniform) {
+                    entries[k] = values[ch][k];
+                    continue;
                 }
-
-                size_t idx = findInterval(irradiance.size(), [&](size_t idx) {
+                float x = first + float(k) / table->scale;
+                size_t idx = findInterval(n, [&](size_t idx) {
                     return irradiance[idx] <= x;
                 });
                 float x0 = irradiance[idx],
                       x1 = irradiance[idx + 1],
-                      y0 = values[i][idx],
-                      y1 = values[i][idx + 1];
-
-                x = (x - x0) / (x1 - x0);
-                result[i] = x*(y1 - y0) + y0;
+                      y0 = values[ch][idx],
+                      y1 = values[ch][idx + 1];
+                entries[k] = x1 > x0 ? lerp((x - x0) / (x1 - x0), y0, y1) : y1;
             }
-            return result;
-        };
 
-        // Fetch parameters
-        float W = parameters.at("W").value;
+            std::vector<float> &curve = table->curves[ch];
+            curve.resize(2 * table->size);
+            for (size_t k = 0; k < table->size; ++k) {
+                curve[2 * k]     = entries[k];
+                curve[2 * k + 1] = k + 1 < table->size ? entries[k + 1] - entries[k] : 0.f;
+            }
+        }
+        return table;
+    }
 
-        // Fetch color
-        Color3f Cin = exposure * color;
+    void updateParameters() override {
+        TonemapOperator::updateParameters();
+        if (!m_table && irradiance.size() > 0) {
+            m_table = buildTable(irradiance, values);
+        }
+    }
 
-        // Apply curve
-        Color3f Cout = eval(Cin / W);
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Table *table = m_table.get();
+        if (!table) {
+            for (size_t i = 0; i < n; ++i) {
+                out.set(i, Color3f(0.f));
+            }
+            return;
+        }
 
-        /* Gamma correction is already included in the mapping above
-           and only clamping is applied. */
-        return clamp(Cout, 0.f, 1.f);
+        const Params &p = m_params.get();
+
+        // Fold the white point into the mapping to table positions
+        const float *curves[3] = { table->curves[0].data(), table->curves[1].data(), table->curves[2].data() };
+        float scale = table->scale / p.W,
+              start = table->start * table->scale,
+              last  = float(table->size - 1);
+        size_t size = table->size;
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply curve
+            auto position = [&](auto x) TONEMAPPER_SIMD_KERNEL {
+                return simd::clamp(x * scale - start, 0.f, last);
+            };
+            decltype(Cin) Cout(simd::interpolate(curves[0], size, position(Cin.r())),
+                               simd::interpolate(curves[1], size, position(Cin.g())),
+                               simd::interpolate(curves[2], size, position(Cin.b())));
+
+            /* Gamma correction is already included in the mapping above
+               and only clamping is applied. */
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
 
     void fromFile(const std::string &filename) override {
         std::filesystem::path path(filename);
         PRINT_("Read camera response function %s ..", path.filename());
 
+        m_table = nullptr;
         irradiance.clear();
         values[0].clear();
         values[1].clear();
         values[2].clear();
 
-        std::ifstream is(filename);
-        if (is.bad() || is.fail()) {
+        // Entries of a pack are given as "<pack>.rfpack:<name>"
+        ResponseFunction rf;
+        size_t separator = filename.find(".rfpack:");
+        if (separator != std::string::npos) {
+            std::string packname = filename.substr(0, separator + 7),
+                        entry    = filename.substr(separator + 8);
+            ResponseFunctionPack pack(packname);
+            if (!pack.isValid()) {
+                PRINT("");
+                WARN("ResponseFunctionDataOperator::fromFile: could not open pack %s.", std::filesystem::path(packname).filename());
+                return;
+            }
+            if (!pack.find(entry, rf)) {
+                PRINT("");
+                WARN("ResponseFunctionDataOperator::fromFile: pack %s has no response function \"%s\".", std::filesystem::path(packname).filename(), entry);
+                return;
+            }
+        } else if (!readResponseFunction(filename, rf)) {
             PRINT("");
             WARN("ResponseFunctionDataOperator::fromFile: could not open data file %s.", path.filename());
             return;
         }
-
-        std::string line;
-        while (std::getline(is, line)) {
-            if (line.length() == 0 || line[0] == '#') {
-                continue;
-            }
-            std::istringstream iss(line);
-
-            float irr, r, g, b;
-            if (!(iss >> irr >> r >> g >> b)) {
-                break;
-            }
-            irradiance.push_back(irr);
-            values[0].push_back(r);
-            values[1].push_back(g);
-            values[2].push_back(b);
+        irradiance = std::move(rf.irradiance);
+        for (size_t ch = 0; ch < 3; ++ch) {
+            values[ch] = std::move(rf.values[ch]);
         }
 
         if (irradiance.size() == 0) {
             PRINT("");
             WARN("ResponseFunctionDataOperator::fromFile: could not read any data in file %s.", path.filename());
         } else {
-            PRINT(" done.");
+            updateParameters();
+            PRINT(" done%s.", m_table && m_table->resampled ? " (resampled to even spacing)" : "");
         }
     }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
+
+    std::unique_ptr<const Table> m_table;
 };
 
 REGISTER_OPERATOR(ResponseFunctionDataFileOperator, "response_function_data_file");
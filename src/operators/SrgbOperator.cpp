@@ -43,25 +43,28 @@ public:
                 out_color = vec4(Cout, 1.0);
             }
         )glsl";
+
+        traits.separable = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        auto toSRGB = [](float value) {
-            if (value < 0.0031308f) {
-                return 12.92f * value;
-            }
-            return 1.055f * std::pow(value, 0.41666f) - 0.055f;
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        auto toSRGB = [](auto value) TONEMAPPER_SIMD_KERNEL {
+            return simd::select(value < 0.0031308f,
+                                12.92f * value,
+                                1.055f * simd::pow(value, 0.41666f) - 0.055f);
         };
 
-        // Fetch color
-        Color3f Cin = exposure * color;
-
-        // Apply sRGB conversion
-        Color3f Cout = Color3f(toSRGB(Cin.r()), toSRGB(Cin.g()), toSRGB(Cin.b()));
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Apply sRGB conversion
+            auto Cout = decltype(Cin)(toSRGB(Cin.r()), toSRGB(Cin.g()), toSRGB(Cin.b()));
 
-        /* Gamma correction is already included in the mapping above
-           and only clamping is applied. */
-        return clamp(Cout, 0.f, 1.f);
+            /* Gamma correction is already included in the mapping above
+               and only clamping is applied. */
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
 };
 
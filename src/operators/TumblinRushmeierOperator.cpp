@@ -67,6 +67,12 @@ public:
         parameters["gamma"] = Parameter(2.2f, 0.f, 10.f,  "gamma", "Gamma correction value.");
         parameters["Ldmax"] = Parameter(80.f, 1.f, 150.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)");
         parameters["Cmax"]  = Parameter(36.f, 1.f, 100.f, "Cmax",  "Maximum contrast ratio betwen on-screen luminances.");
+
+        traits.luminanceScaled = true;
+        traits.needsStatistics = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
@@ -74,37 +80,71 @@ public:
         parameters["Lavg"] = Parameter(image->getMeanLuminance(), "Lavg");
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value,
-              Lavg  = parameters.at("Lavg").value,
-              Ldmax = parameters.at("Ldmax").value,
-              Cmax  = parameters.at("Cmax").value;
-
-        // Fetch color and convert to luminance
-        Color3f Cin = exposure * color;
-        float Lin = luminance(Cin);
+    struct Params {
+        float invGamma;
+        float Lavg;
+        float Ldmax;
+        float invCmax;
+        float alphaD, betaD;    // Display observer adaptation
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.Lavg     = parameters.at("Lavg").value;
+        p.Ldmax    = parameters.at("Ldmax").value;
+
+        float Cmax  = parameters.at("Cmax").value,
+              Lwd   = p.Ldmax / std::sqrt(Cmax),
+              logLd = std::log10(Lwd) + 0.84f;
+        p.invCmax = 1.f / Cmax;
+        p.alphaD  =  0.4f * logLd + 2.92f;
+        p.betaD   = -0.4f * logLd * logLd - 2.584f * logLd + 2.0208f;
+        return p;
+    }
 
+    static auto luminanceCurve(const Params &p, float exposure) {
         // Apply exposure scale to parameters
-        Lavg *= exposure;
+        float Lavg = p.Lavg * exposure;
 
-        // Apply tonemapping curve to luminance
+        // World observer adaptation
         float logLrw   = std::log10(Lavg) + 0.84f,
               alphaRw  =  0.4f * logLrw + 2.92f,
               betaRw   = -0.4f * logLrw * logLrw - 2.584f * logLrw + 2.0208f,
-              Lwd      = Ldmax / std::sqrt(Cmax),
-              logLd    = std::log10(Lwd) + 0.84f,
-              alphaD   =  0.4f * logLd + 2.92f,
-              betaD    = -0.4f * logLd * logLd - 2.584f * logLd + 2.0208f,
-              Lout     = std::pow(Lin, alphaRw / alphaD) / Ldmax * std::pow(10.f, (betaRw - betaD) / alphaD) - (1.f / Cmax);
-
-        // Treat color by preserving color ratios [Schlick 1994].
-        Color3f Cout = Cin / Lin * Lout;
-
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+              exponent = alphaRw / p.alphaD,
+              scale    = std::pow(10.f, (betaRw - p.betaD) / p.alphaD);
+
+        return [=](auto Lin) TONEMAPPER_SIMD_KERNEL {
+            return simd::pow(Lin, exponent) / p.Ldmax * scale - p.invCmax;
+        };
     }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+        auto curve = luminanceCurve(p, exposure);
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Convert to luminance
+            auto Lin = luminance(Cin);
+
+            // Apply tonemapping curve to luminance
+            auto Lout = curve(Lin);
+
+            // Treat color by preserving color ratios [Schlick 1994].
+            auto Cout = Cin / Lin * Lout;
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
+    }
+
+    float mapLuminance(float L, float exposure) const override {
+        return luminanceCurve(m_params.get(), exposure)(L);
+    }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(TumblinRushmeierOperator, "tumblin_rushmeier");
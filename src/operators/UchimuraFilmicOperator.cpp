@@ -73,42 +73,63 @@ public:
         parameters["l"]     = Parameter(0.4f,  0.01f, 0.99f, "l",     "Linear section length.");
         parameters["c"]     = Parameter(1.33f, 1.f,   3.f,   "c",     "Black tightness shape.");
         parameters["b"]     = Parameter(0.f,   0.f,   1.f,   "b",     "Black tightness offset.");
+
+        traits.separable = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // // Fetch parameters
-        float gamma = parameters.at("gamma").value,
-                  P = parameters.at("P").value,
-                  a = parameters.at("a").value,
-                  m = parameters.at("m").value,
-                  l = parameters.at("l").value,
-                  c = parameters.at("c").value,
-                  b = parameters.at("b").value;
-
-        // Fetch color
-        Color3f Cin = exposure * color;
-
-        // Apply curve directly on color input
-        float l0 = ((P - m) * l) / a,
-              S0 = m + l0,
-              S1 = m + a * l0,
-              C2 = (a * P) / (P - S1),
-              CP = -C2 / P;
-
-        Color3f w0 = Color3f(1.f) - smoothstep(Color3f(0.f), Color3f(m), Cin),
-                w2 = step(Color3f(m + l0), Cin),
-                w1 = Color3f(1.f) - w0 - w2;
-
-        Color3f T = m * pow(Cin / m, c) + b,                       // toe
-                L = Color3f(m) + a * (Cin - Color3f(m)),           // linear
-                S = Color3f(P) - (P - S1) * exp(CP * (Cin - S0));  // shoulder
-
-        Color3f Cout = T * w0 + L * w1 + S * w2;
-
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+    struct Params {
+        float invGamma;
+        float P, a, m, c, b;
+        float l0, S0, S1, CP;   // Derived linear section and shoulder constants
+    };
+
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+        p.P        = parameters.at("P").value;
+        p.a        = parameters.at("a").value;
+        p.m        = parameters.at("m").value;
+        p.c        = parameters.at("c").value;
+        p.b        = parameters.at("b").value;
+
+        float l  = parameters.at("l").value,
+              C2;
+        p.l0 = ((p.P - p.m) * l) / p.a;
+        p.S0 = p.m + p.l0;
+        p.S1 = p.m + p.a * p.l0;
+        C2   = (p.a * p.P) / (p.P - p.S1);
+        p.CP = -C2 / p.P;
+        return p;
     }
+
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            typedef decltype(Cin) Color;
+
+            // Apply curve directly on color input
+            Color w0 = Color(1.f) - smoothstep(Color(0.f), Color(p.m), Cin),
+                  w2 = step(Color(p.m + p.l0), Cin),
+                  w1 = Color(1.f) - w0 - w2;
+
+            Color T = p.m * pow(Cin / p.m, p.c) + p.b,                     // toe
+                  L = Color(p.m) + p.a * (Cin - Color(p.m)),               // linear
+                  S = Color(p.P) - (p.P - p.S1) * exp(p.CP * (Cin - p.S0));  // shoulder
+
+            Color Cout = T * w0 + L * w1 + S * w2;
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
+    }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(UchimuraFilmicOperator, "uchimura");
@@ -54,6 +54,12 @@ public:
 
         parameters["gamma"] = Parameter(2.2f, 0.f, 10.f,  "gamma", "Gamma correction value.");
         parameters["Ldmax"] = Parameter(80.f, 1.f, 150.f, "Ldmax", "Maximum luminance capability of the display (cd/m^2)");
+
+        traits.luminanceScaled = true;
+        traits.needsStatistics = true;
+        traits.monotonic = true;
+        traits.outputMin = 0.f;
+        traits.outputMax = 1.f;
     }
 
     void preprocess(const Image *image) override {
@@ -61,29 +67,57 @@ public:
         parameters["Lwa"] = Parameter(image->getLogMeanLuminance(), "Lwa");
     }
 
-    Color3f map(const Color3f &color, float exposure) const override {
-        // Fetch parameters
-        float gamma = parameters.at("gamma").value,
-              Ldmax = parameters.at("Ldmax").value,
-              Lwa   = parameters.at("Lwa").value;
+    struct Params {
+        float invGamma;
+        float scale;    // Contrast based scale factor m / Ldmax
+    };
 
-        // Fetch color and convert to luminance
-        Color3f Cin = exposure * color;
-        float Lin = luminance(Cin);
+    static Params compile(const ParameterMap &parameters) {
+        Params p;
+        p.invGamma = 1.f / parameters.at("gamma").value;
+
+        float Ldmax = parameters.at("Ldmax").value,
+              Lwa   = parameters.at("Lwa").value;
 
-        // Apply tonemapping curve to luminance
         float numerator   = 1.219f + std::pow(0.5f*Ldmax, 0.4f),
               denominator = 1.219f + std::pow(Lwa, 0.4f),
-              m = std::pow(numerator / denominator, 2.5f),
-              Lout = m / Ldmax * Lin;
+              m = std::pow(numerator / denominator, 2.5f);
+        p.scale = m / Ldmax;
+        return p;
+    }
+
+    static auto luminanceCurve(const Params &p, float /*exposure*/) {
+        return [=](auto Lin) TONEMAPPER_SIMD_KERNEL {
+            return p.scale * Lin;
+        };
+    }
 
-        // Treat color by preserving color ratios [Schlick 1994].
-        Color3f Cout = Cin / Lin * Lout;
+    void mapSpan(const ConstPixelSpan &in, const PixelSpan &out, size_t n, float exposure) const override {
+        const Params &p = m_params.get();
+        auto curve = luminanceCurve(p, exposure);
 
-        // Apply gamma curve and clamp
-        Cout = pow(Cout, 1.f / gamma);
-        return clamp(Cout, 0.f, 1.f);
+        simd::mapPixels(in, out, n, exposure, [&](auto Cin) TONEMAPPER_SIMD_KERNEL {
+            // Convert to luminance
+            auto Lin = luminance(Cin);
+
+            // Apply tonemapping curve to luminance
+            auto Lout = curve(Lin);
+
+            // Treat color by preserving color ratios [Schlick 1994].
+            auto Cout = Cin / Lin * Lout;
+
+            // Apply gamma curve and clamp
+            Cout = pow(Cout, p.invGamma);
+            return clamp(Cout, 0.f, 1.f);
+        });
     }
+
+    float mapLuminance(float L, float exposure) const override {
+        return luminanceCurve(m_params.get(), exposure)(L);
+    }
+
+private:
+    CompiledParameters<Params> m_params { this, compile };
 };
 
 REGISTER_OPERATOR(WardOperator, "ward");